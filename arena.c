@@ -0,0 +1,190 @@
+/*********************************************************************
+ ** Program Filename: arena.c
+ ** Description: Bump allocator for data that lives as long as one
+ ** command line: tokens, argument vectors, pipeline stages. Each
+ ** allocation is a pointer bump, and everything is released at once
+ ** by resetArena(). When a command line needed more than one block,
+ ** the reset replaces the chain with a single block big enough for
+ ** all of it, so steady state is one block and no malloc at all.
+ *********************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+
+struct arenaBlock
+{
+  struct arenaBlock* next; // previously filled block
+  size_t size;             // usable bytes in data
+  size_t used;             // bytes handed out
+  char*  data;             // aligned start of the usable bytes
+};
+
+struct Arena
+{
+  struct arenaBlock* current; // block being allocated from
+  size_t blockSize;           // minimum size of a new block
+};
+
+/*********************************************************************
+ ** _roundUp
+ ** Description: Rounds a size up to a multiple of ARENA_ALIGN
+ ** Parameters: size_t size
+ *********************************************************************/
+static size_t _roundUp(size_t size)
+{
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/*********************************************************************
+ ** _newBlock
+ ** Description: Allocates a block with at least size usable bytes
+ ** Parameters: size_t size
+ *********************************************************************/
+static struct arenaBlock* _newBlock(size_t size)
+{
+  struct arenaBlock* block;
+  size_t header = _roundUp(sizeof(struct arenaBlock));
+
+  block = malloc(header + size);
+  assert(block != 0);
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  block->data = (char*)block + header;
+  return block;
+}
+
+/*********************************************************************
+ ** createArena
+ ** Description: Allocates an arena whose blocks are at least
+ ** blockSize bytes
+ ** Parameters: size_t blockSize
+ *********************************************************************/
+Arena* createArena(size_t blockSize)
+{
+  Arena* a;
+
+  assert(blockSize > 0);
+  a = malloc(sizeof(Arena));
+  assert(a != 0);
+  a->blockSize = blockSize;
+  a->current = _newBlock(blockSize);
+  return a;
+}
+
+/*********************************************************************
+ ** deleteArena
+ ** Description: Frees the arena and all of its blocks
+ ** Parameters: Arena* a
+ *********************************************************************/
+void deleteArena(Arena* a)
+{
+  struct arenaBlock* block;
+
+  assert(a != 0);
+  while (a->current != NULL)
+  {
+    block = a->current;
+    a->current = block->next;
+    free(block);
+  }
+  free(a);
+}
+
+/*********************************************************************
+ ** resetArena
+ ** Description: Releases every allocation. If more than one block was
+ ** in use they are merged into one block of their combined size
+ ** Parameters: Arena* a
+ *********************************************************************/
+void resetArena(Arena* a)
+{
+  struct arenaBlock* block;
+  size_t total = 0;
+
+  assert(a != 0);
+  if (a->current->next != NULL)
+  {
+    while (a->current != NULL)
+    {
+      block = a->current;
+      total += block->size;
+      a->current = block->next;
+      free(block);
+    }
+    a->current = _newBlock(total);
+  }
+  a->current->used = 0;
+}
+
+/*********************************************************************
+ ** allocArena
+ ** Description: Returns size bytes, aligned for any type, that stay
+ ** valid until the next reset
+ ** Parameters: Arena* a, size_t size
+ *********************************************************************/
+void* allocArena(Arena* a, size_t size)
+{
+  struct arenaBlock* block;
+  void* memory;
+
+  assert(a != 0);
+  size = _roundUp(size);
+
+  if (a->current->size - a->current->used < size)
+  {
+    block = _newBlock(size > a->blockSize ? size : a->blockSize);
+    block->next = a->current;
+    a->current = block;
+  }
+
+  memory = a->current->data + a->current->used;
+  a->current->used += size;
+  return memory;
+}
+
+/*********************************************************************
+ ** copyArena
+ ** Description: Returns a '\0'-terminated copy of length bytes of s
+ ** Parameters: Arena* a, const char* s, size_t length
+ *********************************************************************/
+char* copyArena(Arena* a, const char* s, size_t length)
+{
+  char* copy = allocArena(a, length + 1);
+
+  memcpy(copy, s, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+/*********************************************************************
+ ** growArena
+ ** Description: Returns a copy of an arena allocation enlarged to
+ ** newSize bytes. If old is the most recent allocation and there is
+ ** room, it is extended in place
+ ** Parameters: Arena* a, void* old, size_t oldSize, size_t newSize
+ *********************************************************************/
+void* growArena(Arena* a, void* old, size_t oldSize, size_t newSize)
+{
+  struct arenaBlock* block = a->current;
+  size_t oldRounded = _roundUp(oldSize),
+         newRounded = _roundUp(newSize);
+  void* memory;
+
+  assert(newSize >= oldSize);
+  if (old != NULL && (char*)old + oldRounded == block->data + block->used &&
+      block->used - oldRounded + newRounded <= block->size)
+  {
+    block->used += newRounded - oldRounded;
+    return old;
+  }
+
+  memory = allocArena(a, newSize);
+  if (old != NULL)
+    memcpy(memory, old, oldSize);
+  return memory;
+}
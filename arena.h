@@ -0,0 +1,22 @@
+/* 	arena.h : Bump allocator reset once per command line. */
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED 1
+
+#include <stddef.h>
+
+typedef struct Arena Arena;
+
+Arena *createArena(size_t blockSize);
+void deleteArena(Arena *a);
+
+/* Frees everything allocated since the last reset at once */
+void resetArena(Arena *a);
+
+void *allocArena(Arena *a, size_t size);
+char *copyArena(Arena *a, const char *s, size_t length);
+
+/* Returns a copy of old enlarged to newSize bytes. The old space is
+   not reused until the next reset. */
+void *growArena(Arena *a, void *old, size_t oldSize, size_t newSize);
+
+#endif
@@ -0,0 +1,492 @@
+/*********************************************************************
+ ** Program Filename: auditLog.c
+ ** Description: Audit log of the commands the shell runs, one JSON
+ ** object per line. The shell formats each record into a buffer of
+ ** its own and copies it into a ring buffer; a writer thread drains
+ ** the ring to the file. The ring has one producer and one consumer,
+ ** so each side only advances its own index and neither ever takes a
+ ** lock. After each batch the writer lingers a few milliseconds for
+ ** more before it sleeps on an eventfd, which the shell signals only
+ ** when the writer has said it is asleep, so a burst of commands
+ ** costs one wakeup rather than a system call and a context switch
+ ** per record. If the ring is full the record is dropped and counted
+ ** rather than waited for.
+ **
+ ** Once started, the writer thread neither allocates memory nor uses
+ ** stdio streams, so a child forked while it runs cannot inherit a
+ ** lock it holds. It blocks every signal, so they keep going to the
+ ** shell's thread.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include "auditLog.h"
+
+#define AUDIT_RING_BYTES (1 << 20) // queued records, a power of two
+#define AUDIT_KEEP 3               // rotated files kept, path.1 to path.3
+#define AUDIT_LINGER_MS 5          // wait for more before sleeping
+
+struct AuditLog
+{
+  char*     ring;         // AUDIT_RING_BYTES of queued records
+  size_t    head;         // bytes ever queued, advanced by the shell
+  size_t    tail;         // bytes ever written, advanced by the writer
+  int       sleepingFlag; // set while the writer waits on wakeFd
+  int       closingFlag;  // set when the writer should finish and stop
+  int       wakeFd;       // eventfd the writer sleeps on
+  pthread_t writer;
+
+  // Used only by the writer thread
+  int       fd;           // the log file, opened for appending
+  char*     path;
+  long      rotateBytes;  // size at which the file is rotated
+  long      fileSize;
+
+  // Used only by the shell's thread
+  char*     record;       // record being built
+  size_t    recordLength;
+  size_t    recordCapacity;
+  int       commaFlag;    // set if the next value needs a comma first
+  long      dropped;      // records dropped since the log was opened
+  long      unreported;   // and not yet noted in the log
+};
+
+/*********************************************************************
+ ** _writeAll
+ ** Description: Writes length bytes to the log file. A failed write is
+ ** given up on; the log is best effort
+ ** Parameters: AuditLog* a, const char* data, size_t length
+ *********************************************************************/
+static void _writeAll(AuditLog* a, const char* data, size_t length)
+{
+  ssize_t written;
+
+  while (length > 0)
+  {
+    written = write(a->fd, data, length);
+    if (written == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    data += written;
+    length -= written;
+    a->fileSize += written;
+  }
+}
+
+/*********************************************************************
+ ** _rotate
+ ** Description: Shifts path.1 to path.2 and so on, dropping the
+ ** oldest, renames the log to path.1 and starts a new one. If no new
+ ** file can be made, writing carries on in the renamed one
+ ** Parameters: AuditLog* a
+ *********************************************************************/
+static void _rotate(AuditLog* a)
+{
+  char from[PATH_MAX + 16],
+       to[PATH_MAX + 16];
+  int fd,
+      i;
+
+  for (i = AUDIT_KEEP - 1; i >= 1; i--)
+  {
+    snprintf(from, sizeof(from), "%s.%d", a->path, i);
+    snprintf(to, sizeof(to), "%s.%d", a->path, i + 1);
+    rename(from, to);
+  }
+  snprintf(to, sizeof(to), "%s.1", a->path);
+  rename(a->path, to);
+
+  fd = open(a->path, O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC, 0600);
+  if (fd == -1)
+    return;
+  close(a->fd);
+  a->fd = fd;
+  a->fileSize = 0;
+}
+
+/*********************************************************************
+ ** _drain
+ ** Description: The writer thread. Writes out whatever the shell has
+ ** queued, a whole batch at a time. When there is none it first
+ ** waits AUDIT_LINGER_MS unannounced, and only if nothing came then
+ ** sleeps until woken. Before sleeping it sets sleepingFlag and looks
+ ** once more, so a record queued at that moment is either seen or
+ ** causes a wakeup
+ ** Parameters: void* log
+ *********************************************************************/
+static void* _drain(void* log)
+{
+  AuditLog* a = log;
+  size_t tail = a->tail,
+         head,
+         offset,
+         first;
+  uint64_t count;
+  struct pollfd wake = { .fd = a->wakeFd, .events = POLLIN };
+  int lingerFlag = 0; // set once the writer has lingered with no records
+
+  for (;;)
+  {
+    head = __atomic_load_n(&a->head, __ATOMIC_SEQ_CST);
+    if (head == tail)
+    {
+      if (__atomic_load_n(&a->closingFlag, __ATOMIC_SEQ_CST))
+        break;
+      if (!lingerFlag)
+      {
+        // Only closeAuditLog() signals the eventfd while awake
+        if (poll(&wake, 1, AUDIT_LINGER_MS) == 1)
+          read(a->wakeFd, &count, sizeof(count));
+        lingerFlag = 1;
+        continue;
+      }
+      __atomic_store_n(&a->sleepingFlag, 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&a->head, __ATOMIC_SEQ_CST) == tail &&
+          !__atomic_load_n(&a->closingFlag, __ATOMIC_SEQ_CST))
+        read(a->wakeFd, &count, sizeof(count));
+      __atomic_store_n(&a->sleepingFlag, 0, __ATOMIC_SEQ_CST);
+      continue;
+    }
+
+    lingerFlag = 0;
+
+    // Batches hold whole records, so rotating between them never
+    // splits a line
+    if (a->fileSize > 0 && a->fileSize + (long)(head - tail) > a->rotateBytes)
+      _rotate(a);
+
+    offset = tail & (AUDIT_RING_BYTES - 1);
+    first = head - tail;
+    if (first > AUDIT_RING_BYTES - offset)
+      first = AUDIT_RING_BYTES - offset;
+    _writeAll(a, a->ring + offset, first);
+    _writeAll(a, a->ring, head - tail - first);
+
+    tail = head;
+    __atomic_store_n(&a->tail, tail, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+/*********************************************************************
+ ** openAuditLog
+ ** Description: Opens the log file and starts the writer thread with
+ ** every signal blocked
+ ** Parameters: const char* path, long rotateBytes
+ *********************************************************************/
+AuditLog* openAuditLog(const char* path, long rotateBytes)
+{
+  AuditLog* a;
+  struct stat info;
+  sigset_t allSignals,
+           oldSignals;
+  int result;
+
+  a = calloc(1, sizeof(AuditLog));
+  assert(a != 0);
+  a->fd = open(path, O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC, 0600);
+  a->wakeFd = eventfd(0, EFD_CLOEXEC);
+  if (a->fd == -1 || a->wakeFd == -1)
+  {
+    if (a->fd != -1)
+      close(a->fd);
+    if (a->wakeFd != -1)
+      close(a->wakeFd);
+    free(a);
+    return NULL;
+  }
+  if (fstat(a->fd, &info) == 0)
+    a->fileSize = info.st_size;
+  a->path = strdup(path);
+  a->rotateBytes = rotateBytes;
+  a->ring = malloc(AUDIT_RING_BYTES);
+  a->recordCapacity = 1024;
+  a->record = malloc(a->recordCapacity);
+  assert(a->path != 0 && a->ring != 0 && a->record != 0);
+
+  sigfillset(&allSignals);
+  pthread_sigmask(SIG_SETMASK, &allSignals, &oldSignals);
+  result = pthread_create(&a->writer, NULL, _drain, a);
+  pthread_sigmask(SIG_SETMASK, &oldSignals, NULL);
+  if (result != 0)
+  {
+    close(a->fd);
+    close(a->wakeFd);
+    free(a->path);
+    free(a->ring);
+    free(a->record);
+    free(a);
+    return NULL;
+  }
+  return a;
+}
+
+/*********************************************************************
+ ** closeAuditLog
+ ** Description: Tells the writer to finish, waits for it to write out
+ ** the queue, and frees the log
+ ** Parameters: AuditLog* a
+ *********************************************************************/
+void closeAuditLog(AuditLog* a)
+{
+  uint64_t one = 1;
+
+  assert(a != 0);
+  __atomic_store_n(&a->closingFlag, 1, __ATOMIC_SEQ_CST);
+  write(a->wakeFd, &one, sizeof(one));
+  pthread_join(a->writer, NULL);
+
+  close(a->fd);
+  close(a->wakeFd);
+  free(a->path);
+  free(a->ring);
+  free(a->record);
+  free(a);
+}
+
+/*********************************************************************
+ ** _append
+ ** Description: Adds bytes to the record being built
+ ** Parameters: AuditLog* a, const char* data, size_t length
+ *********************************************************************/
+static void _append(AuditLog* a, const char* data, size_t length)
+{
+  if (a->recordLength + length > a->recordCapacity)
+  {
+    while (a->recordLength + length > a->recordCapacity)
+      a->recordCapacity *= 2;
+    a->record = realloc(a->record, a->recordCapacity);
+    assert(a->record != 0);
+  }
+  memcpy(a->record + a->recordLength, data, length);
+  a->recordLength += length;
+}
+
+/*********************************************************************
+ ** _key
+ ** Description: Starts a value: a comma after the one before it, then
+ ** the key unless the value is in a list
+ ** Parameters: AuditLog* a, const char* key
+ *********************************************************************/
+static void _key(AuditLog* a, const char* key)
+{
+  if (a->commaFlag)
+    _append(a, ", ", 2);
+  if (key != NULL)
+  {
+    _append(a, "\"", 1);
+    _append(a, key, strlen(key));
+    _append(a, "\": ", 3);
+  }
+  a->commaFlag = 1;
+}
+
+/*********************************************************************
+ ** beginAuditRecord
+ ** Description: Starts a new record, discarding any unfinished one
+ ** Parameters: AuditLog* a
+ *********************************************************************/
+void beginAuditRecord(AuditLog* a)
+{
+  assert(a != 0);
+  a->recordLength = 0;
+  _append(a, "{", 1);
+  a->commaFlag = 0;
+}
+
+/*********************************************************************
+ ** addAuditString
+ ** Description: Adds text as a JSON string, escaping quotes,
+ ** backslashes and control characters
+ ** Parameters: AuditLog* a, const char* key, const char* text,
+ ** size_t length
+ *********************************************************************/
+void addAuditString(AuditLog* a, const char* key, const char* text,
+                    size_t length)
+{
+  char escape[8];
+  size_t start = 0,
+         i;
+  unsigned char c;
+
+  assert(a != 0);
+  _key(a, key);
+  _append(a, "\"", 1);
+  for (i = 0; i < length; i++)
+  {
+    c = (unsigned char)text[i];
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+
+    // Copy the plain run before the character, then its escape
+    _append(a, text + start, i - start);
+    if (c == '"' || c == '\\')
+      snprintf(escape, sizeof(escape), "\\%c", c);
+    else if (c == '\n')
+      strcpy(escape, "\\n");
+    else if (c == '\t')
+      strcpy(escape, "\\t");
+    else
+      snprintf(escape, sizeof(escape), "\\u%04x", c);
+    _append(a, escape, strlen(escape));
+    start = i + 1;
+  }
+  _append(a, text + start, length - start);
+  _append(a, "\"", 1);
+}
+
+/*********************************************************************
+ ** addAuditNumber
+ ** Description: Adds an integer
+ ** Parameters: AuditLog* a, const char* key, long value
+ *********************************************************************/
+void addAuditNumber(AuditLog* a, const char* key, long value)
+{
+  char number[24];
+
+  assert(a != 0);
+  _key(a, key);
+  _append(a, number, snprintf(number, sizeof(number), "%ld", value));
+}
+
+/*********************************************************************
+ ** addAuditFlag
+ ** Description: Adds true or false
+ ** Parameters: AuditLog* a, const char* key, int value
+ *********************************************************************/
+void addAuditFlag(AuditLog* a, const char* key, int value)
+{
+  assert(a != 0);
+  _key(a, key);
+  if (value)
+    _append(a, "true", 4);
+  else
+    _append(a, "false", 5);
+}
+
+/*********************************************************************
+ ** addAuditTime
+ ** Description: Adds a time as seconds since the epoch, to the
+ ** microsecond
+ ** Parameters: AuditLog* a, const char* key, struct timespec* time
+ *********************************************************************/
+void addAuditTime(AuditLog* a, const char* key, struct timespec* time)
+{
+  char number[40];
+
+  assert(a != 0);
+  _key(a, key);
+  _append(a, number, snprintf(number, sizeof(number), "%ld.%06ld",
+                              (long)time->tv_sec, time->tv_nsec / 1000));
+}
+
+/*********************************************************************
+ ** openAuditGroup
+ ** Description: Opens a list or object
+ ** Parameters: AuditLog* a, const char* key, char bracket
+ *********************************************************************/
+void openAuditGroup(AuditLog* a, const char* key, char bracket)
+{
+  assert(a != 0);
+  _key(a, key);
+  _append(a, &bracket, 1);
+  a->commaFlag = 0;
+}
+
+/*********************************************************************
+ ** closeAuditGroup
+ ** Description: Closes the innermost list or object
+ ** Parameters: AuditLog* a, char bracket
+ *********************************************************************/
+void closeAuditGroup(AuditLog* a, char bracket)
+{
+  assert(a != 0);
+  _append(a, &bracket, 1);
+  a->commaFlag = 1;
+}
+
+/*********************************************************************
+ ** _queue
+ ** Description: Copies length bytes into the ring and publishes them
+ ** to the writer. Returns 0, or -1 if there is not room
+ ** Parameters: AuditLog* a, const char* data, size_t length
+ *********************************************************************/
+static int _queue(AuditLog* a, const char* data, size_t length)
+{
+  size_t head = a->head,
+         tail = __atomic_load_n(&a->tail, __ATOMIC_ACQUIRE),
+         offset,
+         first;
+
+  if (length > AUDIT_RING_BYTES - (head - tail))
+    return -1;
+
+  offset = head & (AUDIT_RING_BYTES - 1);
+  first = length;
+  if (first > AUDIT_RING_BYTES - offset)
+    first = AUDIT_RING_BYTES - offset;
+  memcpy(a->ring + offset, data, first);
+  memcpy(a->ring, data + first, length - first);
+  __atomic_store_n(&a->head, head + length, __ATOMIC_SEQ_CST);
+  return 0;
+}
+
+/*********************************************************************
+ ** endAuditRecord
+ ** Description: Finishes the record and queues it, after a note of any
+ ** records dropped before it. Wakes the writer if it is asleep
+ ** Parameters: AuditLog* a
+ *********************************************************************/
+void endAuditRecord(AuditLog* a)
+{
+  char note[64];
+  uint64_t one = 1;
+  int length;
+
+  assert(a != 0);
+  _append(a, "}\n", 2);
+
+  if (a->unreported > 0)
+  {
+    length = snprintf(note, sizeof(note),
+                      "{\"event\": \"dropped\", \"count\": %ld}\n",
+                      a->unreported);
+    if (_queue(a, note, length) == 0)
+      a->unreported = 0;
+  }
+  if (a->unreported > 0 || _queue(a, a->record, a->recordLength) == -1)
+  {
+    a->dropped++;
+    a->unreported++;
+  }
+
+  if (__atomic_exchange_n(&a->sleepingFlag, 0, __ATOMIC_SEQ_CST))
+    write(a->wakeFd, &one, sizeof(one));
+}
+
+/*********************************************************************
+ ** droppedAuditRecords
+ ** Description: Returns the number of records dropped on a full ring
+ ** Parameters: AuditLog* a
+ *********************************************************************/
+long droppedAuditRecords(AuditLog* a)
+{
+  assert(a != 0);
+  return a->dropped;
+}
@@ -0,0 +1,42 @@
+/* 	auditLog.h : JSON-lines command log written by a background thread. */
+#ifndef AUDIT_LOG_INCLUDED
+#define AUDIT_LOG_INCLUDED 1
+
+#include <stddef.h>
+#include <time.h>
+
+typedef struct AuditLog AuditLog;
+
+/* Opens (creating it if needed) the log at path and starts its writer
+   thread. Once the file passes rotateBytes it is renamed to path.1
+   (older ones to path.2 and path.3) and a new one started. Returns
+   NULL if the file or thread cannot be had. */
+AuditLog *openAuditLog(const char *path, long rotateBytes);
+
+/* Writes out every record still queued, then stops the thread */
+void closeAuditLog(AuditLog *a);
+
+/* Records are built one value at a time and queued whole by
+   endAuditRecord(). A key is NULL for the values inside a list. */
+void beginAuditRecord(AuditLog *a);
+void addAuditString(AuditLog *a, const char *key, const char *text,
+                    size_t length);
+void addAuditNumber(AuditLog *a, const char *key, long value);
+void addAuditFlag(AuditLog *a, const char *key, int value);
+
+/* Adds a CLOCK_REALTIME time as seconds since the epoch */
+void addAuditTime(AuditLog *a, const char *key, struct timespec *time);
+
+/* Opens a list ('[') or object ('{'), and closes it (']' or '}') */
+void openAuditGroup(AuditLog *a, const char *key, char bracket);
+void closeAuditGroup(AuditLog *a, char bracket);
+
+/* Queues the record for the writer thread without waiting. If the
+   queue is full the record is dropped and counted instead; the count
+   is written to the log in a "dropped" record once there is room. */
+void endAuditRecord(AuditLog *a);
+
+/* Returns the number of records dropped since the log was opened */
+long droppedAuditRecords(AuditLog *a);
+
+#endif
@@ -0,0 +1,240 @@
+/*********************************************************************
+ ** Program Filename: dynArrBench.c
+ ** Description: Microbenchmark for the int DynArr search and removal
+ ** kernels. Each workload times the vectorized function against the
+ ** element-by-element loop it replaced and prints one JSON object
+ ** with nanoseconds per call for both and the speedup.
+ **
+ ** Usage: dynArrBench [calls per workload]
+ *********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "dynamicArray.h"
+
+// PIDs removed per call in the remove workload, about what one pass of
+// exitCommand() reaps
+#define REAPED_COUNT 8
+
+// Largest array benchmarked
+#define MAX_SIZE 4096
+
+// Results are summed here so the compiler cannot drop the calls
+volatile long sink;
+
+// Array contents: PIDs from 1000 up in steps of 3
+int pids[MAX_SIZE];
+
+// Function prototypes
+long nowNs();
+int  scalarContains(DynArr* v, int val);
+int  scalarCount(DynArr* v, int val);
+void scalarRemoveEach(DynArr* v, const int* values, int count);
+void fill(DynArr* v, int size);
+void printResult(const char* workload, int size, double scalarNs,
+                 double vectorNs);
+void findWorkload(int size, int calls);
+void countWorkload(int size, int calls);
+void removeWorkload(int size, int calls);
+
+/*********************************************************************
+ ** nowNs
+ ** Description: Returns CLOCK_MONOTONIC time in nanoseconds
+ ** Parameters: none
+ *********************************************************************/
+long nowNs()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/*********************************************************************
+ ** scalarContains
+ ** Description: containsDynArr() as it was, one getDynArr() and one
+ ** sizeDynArr() per element
+ ** Parameters: DynArr* v, int val
+ *********************************************************************/
+int scalarContains(DynArr* v, int val)
+{
+  int i;
+
+  for (i = 0; i < sizeDynArr(v); i++)
+    if (getDynArr(v, i) == val)
+      return 1;
+  return 0;
+}
+
+/*********************************************************************
+ ** scalarCount
+ ** Description: Counts val element by element, as a caller had to
+ ** before countDynArr()
+ ** Parameters: DynArr* v, int val
+ *********************************************************************/
+int scalarCount(DynArr* v, int val)
+{
+  int found = 0,
+      i;
+
+  for (i = 0; i < sizeDynArr(v); i++)
+    if (getDynArr(v, i) == val)
+      found++;
+  return found;
+}
+
+/*********************************************************************
+ ** scalarRemoveEach
+ ** Description: Removes values the way exitCommand() did, a contains
+ ** and a remove (each a scan, the remove also a shift) per value
+ ** Parameters: DynArr* v, const int* values, int count
+ *********************************************************************/
+void scalarRemoveEach(DynArr* v, const int* values, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+    if (scalarContains(v, values[i]))
+      removeDynArr(v, values[i]);
+}
+
+/*********************************************************************
+ ** fill
+ ** Description: Sets v to the first size PIDs of pids[]
+ ** Parameters: DynArr* v, int size
+ *********************************************************************/
+void fill(DynArr* v, int size)
+{
+  clearDynArr(v);
+  addAllDynArr(v, pids, size);
+}
+
+/*********************************************************************
+ ** printResult
+ ** Description: Prints a workload's result as one line of JSON
+ ** Parameters: const char* workload, int size, double scalarNs,
+ ** double vectorNs
+ *********************************************************************/
+void printResult(const char* workload, int size, double scalarNs,
+                 double vectorNs)
+{
+  printf("{\"workload\": \"%s\", \"elements\": %d, \"scalar_ns\": %.1f, "
+         "\"vector_ns\": %.1f, \"speedup\": %.2f}\n", workload, size,
+         scalarNs, vectorNs, vectorNs > 0 ? scalarNs / vectorNs : 0.0);
+  fflush(stdout);
+}
+
+/*********************************************************************
+ ** findWorkload
+ ** Description: Searches for a missing value, so both versions scan
+ ** the whole array
+ ** Parameters: int size, int calls
+ *********************************************************************/
+void findWorkload(int size, int calls)
+{
+  DynArr* v = createDynArr(size);
+  long start;
+  double scalarNs;
+  int i;
+
+  fill(v, size);
+  start = nowNs();
+  for (i = 0; i < calls; i++)
+    sink += scalarContains(v, 1 + (i & 1));
+  scalarNs = (double)(nowNs() - start) / calls;
+
+  start = nowNs();
+  for (i = 0; i < calls; i++)
+    sink += containsDynArr(v, 1 + (i & 1));
+  printResult("find", size, scalarNs, (double)(nowNs() - start) / calls);
+  deleteDynArr(v);
+}
+
+/*********************************************************************
+ ** countWorkload
+ ** Description: Counts a value present once
+ ** Parameters: int size, int calls
+ *********************************************************************/
+void countWorkload(int size, int calls)
+{
+  DynArr* v = createDynArr(size);
+  long start;
+  double scalarNs;
+  int i;
+
+  fill(v, size);
+  start = nowNs();
+  for (i = 0; i < calls; i++)
+    sink += scalarCount(v, pids[size / 2]);
+  scalarNs = (double)(nowNs() - start) / calls;
+
+  start = nowNs();
+  for (i = 0; i < calls; i++)
+    sink += countDynArr(v, pids[size / 2]);
+  printResult("count", size, scalarNs, (double)(nowNs() - start) / calls);
+  deleteDynArr(v);
+}
+
+/*********************************************************************
+ ** removeWorkload
+ ** Description: Removes REAPED_COUNT PIDs spread through the array.
+ ** The array is refilled before every call, and the refill is timed
+ ** with both versions
+ ** Parameters: int size, int calls
+ *********************************************************************/
+void removeWorkload(int size, int calls)
+{
+  DynArr* v = createDynArr(size);
+  int reaped[REAPED_COUNT];
+  long start;
+  double scalarNs;
+  int i;
+
+  for (i = 0; i < REAPED_COUNT; i++)
+    reaped[i] = pids[size - 1 - i * (size / REAPED_COUNT)];
+
+  start = nowNs();
+  for (i = 0; i < calls; i++)
+  {
+    fill(v, size);
+    scalarRemoveEach(v, reaped, REAPED_COUNT);
+    sink += sizeDynArr(v);
+  }
+  scalarNs = (double)(nowNs() - start) / calls;
+
+  start = nowNs();
+  for (i = 0; i < calls; i++)
+  {
+    fill(v, size);
+    removeAllMatchingDynArr(v, reaped, REAPED_COUNT);
+    sink += sizeDynArr(v);
+  }
+  printResult("remove_matching", size, scalarNs,
+              (double)(nowNs() - start) / calls);
+  deleteDynArr(v);
+}
+
+int main(int argc, char* argv[])
+{
+  static const int sizes[] = { 16, 256, MAX_SIZE };
+  int calls = argc > 1 ? atoi(argv[1]) : 200000,
+      i;
+
+  if (calls <= 0)
+  {
+    fprintf(stderr, "usage: dynArrBench [calls]\n");
+    return 1;
+  }
+  for (i = 0; i < MAX_SIZE; i++)
+    pids[i] = 1000 + 3 * i;
+
+  // Larger arrays get proportionally fewer calls
+  for (i = 0; i < 3; i++)
+  {
+    findWorkload(sizes[i], calls * 16 / sizes[i] + 1);
+    countWorkload(sizes[i], calls * 16 / sizes[i] + 1);
+    removeWorkload(sizes[i], calls * 16 / sizes[i] + 1);
+  }
+  return 0;
+}
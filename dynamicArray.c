@@ -1,550 +1,496 @@
-/*	dynArr.c: Dynamic Array implementation. */
+/*********************************************************************
+ ** Program Filename: dynamicArray.c
+ ** Description: Storage for the type-generic dynamic arrays declared
+ ** by dynamicArray.h. Each instance's inline functions work on typed
+ ** elements and call down here, with the element size, only when the
+ ** buffer must grow, shrink or shift, so one copy of this code serves
+ ** every element type. Growth doubles the capacity with realloc(),
+ ** which can often extend the block in place; insertions and removals
+ ** shift the tail with a single memmove() rather than element by
+ ** element.
+ **
+ ** The int kernels compare eight elements per instruction with AVX2,
+ ** or four with SSE2 (always present on x86-64), picking AVX2 at run
+ ** time when the CPU has it; other architectures use plain loops.
+ *********************************************************************/
+
 #include <assert.h>
 #include <stdlib.h>
-#include <stdio.h>
+#include <string.h>
 #include "dynamicArray.h"
 
-struct DynArr
-{
-	TYPE *data;		/* pointer to the data array */
-	int size;		/* Number of elements in the array */
-	int capacity;	/* capacity ofthe array */
-};
-
-struct bag
-{
-	struct DynArr *dynArr;
-};
-
-
-/* ************************************************************************
-	Dynamic Array Functions
-************************************************************************ */
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define DYNARR_X86 1
+#endif
 
-/* Initialize (including allocation of data array) dynamic array.
+// Above this many values, removeIntsDynArrCore() sorts them and
+// binary searches rather than comparing each element with every one
+#define REMOVE_SET_LIMIT 32
 
-	param: 	v		pointer to the dynamic array
-	param:	cap 	capacity of the dynamic array
-	pre:	v is not null
-	post:	internal data array can hold capacity elements
-	post:	v->data is not null
-*/
-void _initDynArr(DynArr *v, int capacity)
+/*********************************************************************
+ ** initDynArrCore
+ ** Description: Allocates an empty buffer for capacity elements
+ ** Parameters: struct dynArrCore* c, int capacity, size_t elementSize
+ *********************************************************************/
+void initDynArrCore(struct dynArrCore* c, int capacity, size_t elementSize)
 {
-	assert(capacity > 0);
-	assert(v!= 0);
-	v->data = malloc(sizeof(TYPE) * capacity);
-	assert(v->data != 0);
-	v->size = 0;
-	v->capacity = capacity;
-
-}
-
-/* Allocate and initialize dynamic array.
-
-	param:	cap 	desired capacity for the dyn array
-	pre:	none
-	post:	none
-	ret:	a non-null pointer to a dynArr of cap capacity
-			and 0 elements in it.		
-*/
-DynArr* createDynArr(int cap)
+  assert(c != 0);
+  assert(capacity > 0);
+  c->data = malloc(elementSize * capacity);
+  assert(c->data != 0);
+  c->size = 0;
+  c->capacity = capacity;
+}
+
+/*********************************************************************
+ ** _setCapacity
+ ** Description: Reallocates the buffer to hold capacity elements
+ ** Parameters: struct dynArrCore* c, int capacity, size_t elementSize
+ *********************************************************************/
+static void _setCapacity(struct dynArrCore* c, int capacity,
+                         size_t elementSize)
 {
-	DynArr *r; 
-	assert(cap > 0);
-	r = malloc(sizeof( DynArr));
-	assert(r != 0);
-	_initDynArr(r,cap);
-	return r;
-}
-
-/* Deallocate data array in dynamic array. 
-
-	param: 	v		pointer to the dynamic array
-	pre:    v is not null
-	post:	d.data points to null
-	post:	size and capacity are 0
-	post:	the memory used by v->data is freed
-*/
-void freeDynArr(DynArr *v)
+  void* data;
+
+  data = realloc(c->data, elementSize * capacity);
+  assert(data != 0);
+  c->data = data;
+  c->capacity = capacity;
+}
+
+/*********************************************************************
+ ** reserveDynArrCore
+ ** Description: Makes room for at least capacity elements. The
+ ** capacity at least doubles, so a run of single appends reallocates
+ ** only a logarithmic number of times
+ ** Parameters: struct dynArrCore* c, int capacity, size_t elementSize
+ *********************************************************************/
+void reserveDynArrCore(struct dynArrCore* c, int capacity,
+                       size_t elementSize)
 {
-	assert(v!=0);
-
-	if(v->data != 0)
-	{
-		free(v->data); 	/* free the space on the heap */
-		v->data = 0;   	/* make it point to null */
-	}
-	v->size = 0;
-	v->capacity = 0;
-}
-
-/* Deallocate data array and the dynamic array ure. 
-
-	param: 	v		pointer to the dynamic array
-	pre:	v is not null
-	post:	the memory used by v->data is freed
-	post:	the memory used by d is freed
-*/
-void deleteDynArr(DynArr *v)
+  int newCapacity;
+
+  assert(c != 0);
+  if (capacity <= c->capacity)
+    return;
+  newCapacity = c->capacity * 2;
+  if (newCapacity < capacity)
+    newCapacity = capacity;
+  _setCapacity(c, newCapacity, elementSize);
+}
+
+/*********************************************************************
+ ** openDynArrCore
+ ** Description: Makes count uninitialized slots at pos, moving the
+ ** elements from pos on up in one memmove
+ ** Parameters: struct dynArrCore* c, int pos, int count,
+ ** size_t elementSize
+ *********************************************************************/
+void openDynArrCore(struct dynArrCore* c, int pos, int count,
+                    size_t elementSize)
 {
-	assert (v!= 0);
-	freeDynArr(v);
-	free(v);
-}
-
-/* Resizes the underlying array to be the size cap 
-
-	param: 	v		pointer to the dynamic array
-	param:	cap		the new desired capacity
-	pre:	v is not null
-	post:	v has capacity newCap
-*/
-void _dynArrSetCapacity(DynArr *v, int newCap)
+  char* data;
+
+  assert(c != 0);
+  assert(pos >= 0 && pos <= c->size);
+  reserveDynArrCore(c, c->size + count, elementSize);
+  data = c->data;
+  memmove(data + (pos + count) * elementSize, data + pos * elementSize,
+          (c->size - pos) * elementSize);
+  c->size += count;
+}
+
+/*********************************************************************
+ ** closeDynArrCore
+ ** Description: Removes count elements at pos, moving the elements
+ ** after them down in one memmove, then shrinks the buffer if needed
+ ** Parameters: struct dynArrCore* c, int pos, int count,
+ ** size_t elementSize
+ *********************************************************************/
+void closeDynArrCore(struct dynArrCore* c, int pos, int count,
+                     size_t elementSize)
 {
-	int i;
-	TYPE *oldData;
-	int oldSize = v->size;
-	oldData = v->data;
-
-	printf("========Resizing========\n");
-	/* Create a new dyn array with larger underlying array */
-	_initDynArr(v, newCap);
-
-	for(i = 0; i < oldSize; i++){
-		v->data[i] = oldData[i];
-	}
-
-	v->size = oldSize;
-	/* Remember, init did not free the original data */
-	free(oldData);
-
-#ifdef ALTERNATIVE
-	int i;
-	
-	/* Create a new underlying array*/
-	TYPE *newData = (TYPE*)malloc(sizeof(TYPE)*newCap);
-	assert(newData != 0);
-	
-	/* copy elements to it */
-	
-	for(i = 0; i < v->size; i++)
-	{
-		newData[i] = v->data[i];
-	}
-	
-	/* Delete the oldunderlying array*/
-	free(v->data);
-	/* update capacity and size and data*/
-	v->data = newData;
-	v->capacity = newCap;
-#endif
-}
-
-/* Get the size of the dynamic array
-
-	param: 	v		pointer to the dynamic array
-	pre:	v is not null
-	post:	none
-	ret:	the size of the dynamic array
-*/
-int sizeDynArr(DynArr *v)
+  char* data;
+
+  assert(c != 0);
+  assert(pos >= 0 && count >= 0 && pos + count <= c->size);
+  data = c->data;
+  memmove(data + pos * elementSize, data + (pos + count) * elementSize,
+          (c->size - pos - count) * elementSize);
+  c->size -= count;
+  shrinkDynArrCore(c, elementSize);
+}
+
+/*********************************************************************
+ ** shrinkDynArrCore
+ ** Description: Halves the capacity once the array is down to a
+ ** quarter full. Waiting for a quarter rather than a half means an
+ ** array cycling around a power of two does not reallocate on every
+ ** add and remove
+ ** Parameters: struct dynArrCore* c, size_t elementSize
+ *********************************************************************/
+void shrinkDynArrCore(struct dynArrCore* c, size_t elementSize)
 {
-	assert(v!=0);
-	return v->size;
-}
-
-/* 	Adds an element to the end of the dynamic array
-
-	param: 	v		pointer to the dynamic array
-	param:	val		the value to add to the end of the dynamic array
-	pre:	the dynArry is not null
-	post:	size increases by 1
-	post:	if reached capacity, capacity is doubled
-	post:	val is in the last utilized position in the array
-*/
-void addDynArr(DynArr *v, TYPE val)
+  assert(c != 0);
+  if (c->capacity > DYNARR_MIN_CAPACITY && c->size <= c->capacity / 4)
+    _setCapacity(c, c->capacity / 2, elementSize);
+}
+
+/*********************************************************************
+ ** _findIntScalar
+ ** Description: Plain loop for findIntDynArrCore(), also used for the
+ ** elements left over after the vector loops
+ ** Parameters: const int* data, int start, int size, int val
+ *********************************************************************/
+static int _findIntScalar(const int* data, int start, int size, int val)
 {
+  int i;
 
-	assert(v!=0);
-
-	/* Check to see if a resize is necessary */
-	if(v->size >= v->capacity)
-		_dynArrSetCapacity(v, 2 * v->capacity);
-	
-	v->data[v->size] = val;
-	v->size++;
-
+  for (i = start; i < size; i++)
+    if (data[i] == val)
+      return i;
+  return -1;
 }
 
-/*	Get an element from the dynamic array from a specified position
-	
-	param: 	v		pointer to the dynamic array
-	param:	pos		integer index to get the element from
-	pre:	v is not null
-	pre:	v is not empty
-	pre:	pos < size of the dyn array and >= 0
-	post:	no changes to the dyn Array
-	ret:	value stored at index pos
-*/
-
-TYPE getDynArr(DynArr *v, int pos)
+/*********************************************************************
+ ** _countIntScalar
+ ** Description: Plain loop for countIntDynArrCore()
+ ** Parameters: const int* data, int start, int size, int val
+ *********************************************************************/
+static int _countIntScalar(const int* data, int start, int size, int val)
 {
-	assert(v!=0);
-	assert(pos < v->size);
-	assert(pos >= 0);
-   
-	return v->data[pos];
-}
+  int found = 0,
+      i;
 
-/*	Put an item into the dynamic array at the specified location,
-	overwriting the element that was there
-
-	param: 	v		pointer to the dynamic array
-	param:	pos		the index to put the value into
-	param:	val		the value to insert 
-	pre:	v is not null
-	pre:	v is not empty
-	pre:	pos >= 0 and pos < size of the array
-	post:	index pos contains new value, val
-*/
-void putDynArr(DynArr *v, int pos, TYPE val)
-{
-	assert(v!=0);
-	assert(pos < v->size);
-	assert(pos >= 0);
-	v->data[pos] = val;
+  for (i = start; i < size; i++)
+    found += data[i] == val;
+  return found;
 }
 
-/*	Swap two specified elements in the dynamic array
-
-	param: 	v		pointer to the dynamic array
-	param:	i,j		the elements to be swapped
-	pre:	v is not null
-	pre:	v is not empty
-	pre:	i, j >= 0 and i,j < size of the dynamic array
-	post:	index i now holds the value at j and index j now holds the value at i
-*/
-void swapDynArr(DynArr *v, int i, int  j)
+/*********************************************************************
+ ** _inSet
+ ** Description: Returns true (1) if val is one of the count values,
+ ** which are sorted when there are more than REMOVE_SET_LIMIT
+ ** Parameters: int val, const int* values, int count
+ *********************************************************************/
+static int _inSet(int val, const int* values, int count)
 {
-	TYPE  temp;
-	assert(v!=0);
-	assert(i < v->size);
-	assert(j < v->size);
-	assert(i >= 0);
-	assert(j >= 0);
-
-	temp = v->data[i];
-	v->data[i] = v->data[j];
-	v->data[j] = temp;
-
-}
-
-/*	Remove the element at the specified location from the array,
-	shifts other elements back one to fill the gap
-
-	param: 	v		pointer to the dynamic array
-	param:	idx		location of element to remove
-	pre:	v is not null
-	pre:	v is not empty
-	pre:	idx < size and idx >= 0
-	post:	the element at idx is removed
-	post:	the elements past idx are moved back one
-*/
-void removeAtDynArr(DynArr *v, int idx){
-	int i;
-	assert(v!= 0);
-	assert(idx < v->size);
-	assert(idx >= 0);
-
-   //Move all elements up
-
-   for(i = idx; i < v->size-1; i++){
-      v->data[i] = v->data[i+1];
-   }
-
-   v->size--;
-
-}
-
-void addAtDynArr(DynArr *v, int idx, TYPE val)
+  int low = 0,
+      high = count - 1,
+      mid,
+      i;
+
+  if (count <= REMOVE_SET_LIMIT)
+  {
+    for (i = 0; i < count; i++)
+      if (values[i] == val)
+        return 1;
+    return 0;
+  }
+  while (low <= high)
+  {
+    mid = low + (high - low) / 2;
+    if (values[mid] == val)
+      return 1;
+    if (values[mid] < val)
+      low = mid + 1;
+    else
+      high = mid - 1;
+  }
+  return 0;
+}
+
+/*********************************************************************
+ ** _removeIntsScalar
+ ** Description: Plain loop for removeIntsDynArrCore(), compacting
+ ** data[start] onwards to data[kept] onwards. Returns the new size
+ ** Parameters: int* data, int start, int kept, int size,
+ ** const int* values, int count
+ *********************************************************************/
+static int _removeIntsScalar(int* data, int start, int kept, int size,
+                             const int* values, int count)
 {
+  int i;
 
-	if(v->size >= v->capacity)
-		_dynArrSetCapacity(v, 2*v->capacity);
-	int i;
-	for(i = v->size; i > idx; i--)
-		v->data[i] = v->data[i-1];
-
-	v->data[idx] = val;
-	v->size++;
+  for (i = start; i < size; i++)
+    if (!_inSet(data[i], values, count))
+      data[kept++] = data[i];
+  return kept;
 }
 
+#ifdef DYNARR_X86
 
-/* ************************************************************************
-	Stack Interface Functions
-************************************************************************ */
-
-/*	Returns boolean (encoded in an int) demonstrating whether or not the 
-	dynamic array stack has an item on it.
-
-	param:	v		pointer to the dynamic array
-	pre:	v is not null
-	post:	none
-	ret:	>0  if empty, otherwise 0
-*/
-int isEmptyDynArr(DynArr *v)
+/*********************************************************************
+ ** _hasAvx2
+ ** Description: Returns true (1) if the CPU supports AVX2, checking
+ ** only once
+ ** Parameters: none
+ *********************************************************************/
+static int _hasAvx2()
 {
-	assert(v!= 0);
-	return !(v->size);
-	/* alternatively:
-
-	if(v->size == 0)
-		return 1;
-	else return 0;
-
-	*/
-
-
-
-}
-
-/* 	Push an element onto the top of the stack
-
-	param:	v		pointer to the dynamic array
-	param:	val		the value to push onto the stack
-	pre:	v is not null
-	post:	size increases by 1
-			if reached capacity, capacity is doubled
-			val is on the top of the stack
-*/
-void pushDynArr(DynArr *v, TYPE val)
+  static int avx2 = -1;
+
+  if (avx2 == -1)
+  {
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2") != 0;
+  }
+  return avx2;
+}
+
+/*********************************************************************
+ ** _findIntAvx2
+ ** Description: findIntDynArrCore() eight elements at a time
+ ** Parameters: const int* data, int size, int val
+ *********************************************************************/
+__attribute__((target("avx2")))
+static int _findIntAvx2(const int* data, int size, int val)
 {
-	assert(v!=0);
-	addDynArr(v, val);
-}
-
-/*	Returns the element at the top of the stack 
-
-	param:	v		pointer to the dynamic array
-	pre:	v is not null
-	pre:	v is not empty
-	post:	no changes to the stack
-*/
-TYPE topDynArr(DynArr *v)
+  __m256i key = _mm256_set1_epi32(val),
+          block;
+  int mask,
+      i;
+
+  for (i = 0; i + 8 <= size; i += 8)
+  {
+    block = _mm256_loadu_si256((const __m256i*)(data + i));
+    mask = _mm256_movemask_ps(
+      _mm256_castsi256_ps(_mm256_cmpeq_epi32(block, key)));
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+  return _findIntScalar(data, i, size, val);
+}
+
+/*********************************************************************
+ ** _findIntSse2
+ ** Description: findIntDynArrCore() four elements at a time
+ ** Parameters: const int* data, int size, int val
+ *********************************************************************/
+static int _findIntSse2(const int* data, int size, int val)
 {
-	assert(v!=0);
-	assert(!isEmptyDynArr(v));
-	return v->data[v->size-1];
-}
-
-/* Removes the element on top of the stack 
-
-	param:	v		pointer to the dynamic array
-	pre:	v is not null
-	pre:	v is not empty
-	post:	size is decremented by 1
-			the top has been removed
-*/
-void popDynArr(DynArr *v)
+  __m128i key = _mm_set1_epi32(val),
+          block;
+  int mask,
+      i;
+
+  for (i = 0; i + 4 <= size; i += 4)
+  {
+    block = _mm_loadu_si128((const __m128i*)(data + i));
+    mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block, key)));
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+  return _findIntScalar(data, i, size, val);
+}
+
+/*********************************************************************
+ ** _countIntAvx2
+ ** Description: countIntDynArrCore() eight elements at a time. A
+ ** match compares as -1, so subtracting the comparison counts it
+ ** Parameters: const int* data, int size, int val
+ *********************************************************************/
+__attribute__((target("avx2")))
+static int _countIntAvx2(const int* data, int size, int val)
 {
-	assert(v!=0);
-	assert(! isEmptyDynArr(v));
-	v->size--; 
-}
-
-/* ************************************************************************
-	Bag Interface Functions
-************************************************************************ */
-
-/*	Returns boolean (encoded as an int) demonstrating whether or not
-	the specified value is in the collection
-	true = 1
-	false = 0
-
-	param:	v		pointer to the dynamic array
-	param:	val		the value to look for in the bag
-	pre:	v is not null
-	pre:	v is not empty
-	post:	no changes to the bag
-*/
-int containsDynArr(DynArr *v, TYPE val)
+  __m256i key = _mm256_set1_epi32(val),
+          total = _mm256_setzero_si256(),
+          block;
+  __m128i half;
+  int i;
+
+  for (i = 0; i + 8 <= size; i += 8)
+  {
+    block = _mm256_loadu_si256((const __m256i*)(data + i));
+    total = _mm256_sub_epi32(total, _mm256_cmpeq_epi32(block, key));
+  }
+  half = _mm_add_epi32(_mm256_castsi256_si128(total),
+                       _mm256_extracti128_si256(total, 1));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+  return _mm_cvtsi128_si32(half) + _countIntScalar(data, i, size, val);
+}
+
+/*********************************************************************
+ ** _countIntSse2
+ ** Description: countIntDynArrCore() four elements at a time
+ ** Parameters: const int* data, int size, int val
+ *********************************************************************/
+static int _countIntSse2(const int* data, int size, int val)
 {
-	int i = 0;
-
-	assert(v!=0);
-	assert(!isEmptyDynArr(v));
-   
-	for(i = 0; i < sizeDynArr(v); i++)
-      if(EQ(v->data[i], val) )
-         return 1;
-      return 0;
-
-}
-
-/*	Removes the first occurrence of the specified value from the collection
-	if it occurs
-
-	param:	v		pointer to the dynamic array
-	param:	val		the value to remove from the array
-	pre:	v is not null
-	pre:	v is not empty
-	post:	val has been removed
-	post:	size of the bag is reduced by 1
-*/
-void removeDynArr(DynArr *v, TYPE val)
+  __m128i key = _mm_set1_epi32(val),
+          total = _mm_setzero_si128(),
+          block;
+  int i;
+
+  for (i = 0; i + 4 <= size; i += 4)
+  {
+    block = _mm_loadu_si128((const __m128i*)(data + i));
+    total = _mm_sub_epi32(total, _mm_cmpeq_epi32(block, key));
+  }
+  total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0x4e));
+  total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0xb1));
+  return _mm_cvtsi128_si32(total) + _countIntScalar(data, i, size, val);
+}
+
+/*********************************************************************
+ ** _removeIntsAvx2
+ ** Description: removeIntsDynArrCore() for a small set, eight elements
+ ** at a time. Blocks with no match are stored back whole; only blocks
+ ** holding a match are compacted element by element. Stores never
+ ** pass the block just loaded, so compacting in place is safe
+ ** Parameters: int* data, int size, const int* values, int count
+ *********************************************************************/
+__attribute__((target("avx2")))
+static int _removeIntsAvx2(int* data, int size, const int* values,
+                           int count)
 {
-	int i = 0;
-	assert(v!=0);
-	assert(!isEmptyDynArr(v));
-	assert(containsDynArr(v,val));  /* Design decision: Error if they try to remove something not in there! */
-
-	for(i = 0; i < sizeDynArr(v); i++)
-      if(EQ(v->data[i], val))
-      {
-           removeAtDynArr(v,i); 
-           break;
-      }
-}
-
-/* Utility function for debugging */
-void _printDynArr(struct DynArr *da)
+  __m256i block,
+          hits;
+  int kept = 0,
+      mask,
+      i,
+      j;
+
+  for (i = 0; i + 8 <= size; i += 8)
+  {
+    block = _mm256_loadu_si256((const __m256i*)(data + i));
+    hits = _mm256_setzero_si256();
+    for (j = 0; j < count; j++)
+      hits = _mm256_or_si256(hits, _mm256_cmpeq_epi32(
+                               block, _mm256_set1_epi32(values[j])));
+    mask = _mm256_movemask_ps(_mm256_castsi256_ps(hits));
+    if (mask == 0)
+    {
+      if (kept != i)
+        _mm256_storeu_si256((__m256i*)(data + kept), block);
+      kept += 8;
+      continue;
+    }
+    for (j = 0; j < 8; j++)
+      if (!(mask & (1 << j)))
+        data[kept++] = data[i + j];
+  }
+  return _removeIntsScalar(data, i, kept, size, values, count);
+}
+
+/*********************************************************************
+ ** _removeIntsSse2
+ ** Description: removeIntsDynArrCore() for a small set, four elements
+ ** at a time, as _removeIntsAvx2()
+ ** Parameters: int* data, int size, const int* values, int count
+ *********************************************************************/
+static int _removeIntsSse2(int* data, int size, const int* values,
+                           int count)
 {
-	int i;
-	for(i=0; i < da->size; i++)
-		printf("DA[%d] == %d\n", i, da->data[i]); 
-}
-
-
-/* Iterator Interface */
-
-struct DynArrIter {
-	int	cur;
-	struct DynArr *lst;
-};
-
-/* Initialize an iterator */
-
-void  initDynArrIter (struct DynArr *lst, struct DynArrIter *itr) {
-	itr->lst = lst;
-	itr->cur = 0;
-}
-
-/* create a new iterator struct and return it */
-
-struct DynArrIter *createDynArrIter(struct DynArr *lst){
-	struct DynArrIter *newItr = malloc(sizeof(struct DynArrIter));
-	assert(newItr != 0);
-	initDynArrIter(lst, newItr);
-	return(newItr);
-}
-
- /* Determines if there are more values in the collection and if so, returns true.  It also
-  * sets up for the subsequent call to 'next' by making cur point to the next value in the collection.
-  */
-int hasNextDynArrIter (struct DynArrIter *itr) {
-
-	if(itr->cur < itr->lst->size)
-		return(1);
-	else return (0);
-
-}
-
-/* returns the next value in the collection */
-TYPE nextDynArrIter (struct DynArrIter *itr) {
-	TYPE val = itr->lst->data[itr->cur];
-	itr->cur++;
-	return(val);
-}
-
-/* removes the last value returned by 'next'
- * Notice that we use a tmp to ensure that the following
- * calls to hasNext and next are correct after removal of the
- * current link.*/
-void removeDynArrIter (struct DynArrIter *itr) {
-	itr->cur--;
-	removeAtDynArr(itr->lst , itr->cur);
+  __m128i block,
+          hits;
+  int kept = 0,
+      mask,
+      i,
+      j;
+
+  for (i = 0; i + 4 <= size; i += 4)
+  {
+    block = _mm_loadu_si128((const __m128i*)(data + i));
+    hits = _mm_setzero_si128();
+    for (j = 0; j < count; j++)
+      hits = _mm_or_si128(hits, _mm_cmpeq_epi32(
+                            block, _mm_set1_epi32(values[j])));
+    mask = _mm_movemask_ps(_mm_castsi128_ps(hits));
+    if (mask == 0)
+    {
+      if (kept != i)
+        _mm_storeu_si128((__m128i*)(data + kept), block);
+      kept += 4;
+      continue;
+    }
+    for (j = 0; j < 4; j++)
+      if (!(mask & (1 << j)))
+        data[kept++] = data[i + j];
+  }
+  return _removeIntsScalar(data, i, kept, size, values, count);
 }
 
+#endif
 
-int _binarySearch(struct DynArr *v, TYPE val)
+/*********************************************************************
+ ** findIntDynArrCore
+ ** Description: Returns the position of the first val in data, or -1
+ ** Parameters: const int* data, int size, int val
+ *********************************************************************/
+int findIntDynArrCore(const int* data, int size, int val)
 {
-	int low  = 0;
-	int high  = v->size;
-	int mid;
-
-	while(low < high)
-	{
-		mid = low + (high-low)/2;
-		if(LT(v->data[mid], val))
-			low = mid + 1;
-		else high = mid;
-	}
-	return low;
+#ifdef DYNARR_X86
+  if (_hasAvx2())
+    return _findIntAvx2(data, size, val);
+  return _findIntSse2(data, size, val);
+#else
+  return _findIntScalar(data, 0, size, val);
+#endif
 }
 
-/* Ordered Bag Interface */
-
-void addODynArr(DynArr *v, TYPE val)
+/*********************************************************************
+ ** countIntDynArrCore
+ ** Description: Returns the number of times val occurs in data
+ ** Parameters: const int* data, int size, int val
+ *********************************************************************/
+int countIntDynArrCore(const int* data, int size, int val)
 {
-	int idx = _binarySearch(v, val);
-	addAtDynArr(v,idx,val);
-}
-
-
-int containsODynArr(DynArr *v, TYPE val){
-	int idx = _binarySearch(v, val);
-	// rem: if it's not in there, it'll return size.  This could hold a previously added value...so must check the index!
-	if (EQ(v->data[idx],val) && idx < v->size)
-		return 1;
-	else return 0;
+#ifdef DYNARR_X86
+  if (_hasAvx2())
+    return _countIntAvx2(data, size, val);
+  return _countIntSse2(data, size, val);
+#else
+  return _countIntScalar(data, 0, size, val);
+#endif
 }
 
-
-void removeODynArr(DynArr *v, TYPE val)
+/*********************************************************************
+ ** _compareInts
+ ** Description: qsort() comparison for ints
+ ** Parameters: const void* a, const void* b
+ *********************************************************************/
+static int _compareInts(const void* a, const void* b)
 {
-	int idx = _binarySearch(v, val);
-	if(EQ(v->data[idx], val))
-		removeAtDynArr(v, idx);
-}
-
-/*Bag Wrapper Interface */
+  int x = *(const int*)a,
+      y = *(const int*)b;
 
-/* We'll cover this around week 3 - when we talk about ways to try to make
- * user code more general and interchangeable.  This is nice because it completely
- * hides the underlying data structure type and allows users to write code using only
- * these functions for a 'bag'.  If they substitute a bag implemented with another data
- * struct, like a LinkedList, then they dont' have to change their code if that LinkedList
- * uses teh same name  (ie. bag).  HOWEVER, there's one big problem!!  The user CANNOT use
- * two different bag implementations in the same coe  (e.g. this dynamic array bag and a linked list bag)
- *
- * C does not have polymorphic variables
- */
-
-struct bag *createBag()
-{
-	struct bag *myBag = malloc(sizeof(struct bag));
-	myBag->dynArr = createDynArr(20);
-	return myBag;
-}
-void addToBag(struct bag* b, TYPE val)
-{
-	addDynArr(b->dynArr, val);
-}
-void removeFromBag(struct bag* b, TYPE val)
-{
-	removeDynArr(b->dynArr, val);
-}
-int containsBag(struct bag* b, TYPE val)
-{
-	return(containsDynArr(b->dynArr, val));
-}
-int isEmptyBag(struct bag* b)
-{
-	return(isEmptyDynArr(b->dynArr));
+  return (x > y) - (x < y);
 }
 
-void printBag(struct bag *b)
+/*********************************************************************
+ ** removeIntsDynArrCore
+ ** Description: Removes every element equal to one of values in one
+ ** pass, keeping the order of the rest, and returns the new size. A
+ ** small set is compared against whole vectors; a large one is sorted
+ ** (in a copy) so each element costs a binary search instead
+ ** Parameters: int* data, int size, const int* values, int count
+ *********************************************************************/
+int removeIntsDynArrCore(int* data, int size, const int* values, int count)
 {
-	_printDynArr(b->dynArr);
+  int* sorted;
+
+  if (count == 0 || size == 0)
+    return size;
+
+  if (count > REMOVE_SET_LIMIT)
+  {
+    sorted = malloc(sizeof(int) * count);
+    assert(sorted != 0);
+    memcpy(sorted, values, sizeof(int) * count);
+    qsort(sorted, count, sizeof(int), _compareInts);
+    size = _removeIntsScalar(data, 0, 0, size, sorted, count);
+    free(sorted);
+    return size;
+  }
+
+#ifdef DYNARR_X86
+  if (_hasAvx2())
+    return _removeIntsAvx2(data, size, values, count);
+  return _removeIntsSse2(data, size, values, count);
+#else
+  return _removeIntsScalar(data, 0, 0, size, values, count);
+#endif
 }
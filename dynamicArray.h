@@ -1,72 +1,455 @@
-/* 	dynArr.h : Dynamic Array implementation. */
+/* 	dynamicArray.h : Type-generic dynamic array. */
+
+/* This header is a template. Include it once per element type, naming
+   the array type first:
+
+     #define DYNARR_NAME OffsetArr
+     #define DYNARR_TYPE off_t
+     #include "dynamicArray.h"
+
+   declares struct OffsetArr with createOffsetArr(), addOffsetArr(),
+   getOffsetArr() and the rest below, as static inline functions over
+   the type-erased storage code in dynamicArray.c. Without a name the
+   int array DynArr is declared. DYNARR_EQ(a, b) and DYNARR_LT(a, b)
+   may be defined for element types without == and <. Arrays of int or
+   another 32-bit integer (pid_t) can define DYNARR_INT_KERNELS to
+   search and remove through the vectorized kernels below, as DynArr
+   does. */
+
 #ifndef DYNAMIC_ARRAY_INCLUDED
 #define DYNAMIC_ARRAY_INCLUDED 1
 
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Capacity an array never shrinks below */
+#define DYNARR_MIN_CAPACITY 8
+
+/* Storage shared by every instance; sizes are in elements */
+struct dynArrCore
+{
+  void* data;
+  int   size;
+  int   capacity;
+};
+
+void initDynArrCore(struct dynArrCore *c, int capacity, size_t elementSize);
+
+/* Grows the capacity to at least the given number of elements,
+   doubling it so that appends take amortized constant time */
+void reserveDynArrCore(struct dynArrCore *c, int capacity,
+                       size_t elementSize);
+
+/* Opens a gap of count elements at pos with one memmove */
+void openDynArrCore(struct dynArrCore *c, int pos, int count,
+                    size_t elementSize);
 
-# ifndef TYPE
-# define TYPE      int
-# define TYPE_SIZE sizeof(int)
-# endif
+/* Closes count elements at pos with one memmove, then shrinks */
+void closeDynArrCore(struct dynArrCore *c, int pos, int count,
+                     size_t elementSize);
 
-# ifndef LT
-# define LT(A, B) ((A) < (B))
-# endif
+/* Halves the capacity while at most a quarter of it is used */
+void shrinkDynArrCore(struct dynArrCore *c, size_t elementSize);
 
-# ifndef EQ
-# define EQ(A, B) ((A) == (B))
-# endif
+/* Vectorized kernels for 32-bit ints, using AVX2 or SSE2 as the CPU
+   allows and plain loops elsewhere */
 
+/* Returns the position of the first val in data, or -1 */
+int findIntDynArrCore(const int *data, int size, int val);
 
+/* Returns the number of times val occurs in data */
+int countIntDynArrCore(const int *data, int size, int val);
 
-typedef struct DynArr DynArr;
-struct DynArrIter;
+/* Removes every element equal to one of values, keeping the order of
+   the rest. Returns the new size */
+int removeIntsDynArrCore(int *data, int size, const int *values,
+                         int count);
 
-struct bag;
+#define _DYNARR_PASTE(a, b) a##b
+#define _DYNARR_JOIN(a, b) _DYNARR_PASTE(a, b)
 
+#endif
+
+#if !defined(DYNARR_NAME) && !defined(DYNARR_INT_INCLUDED)
+#define DYNARR_INT_INCLUDED 1
+#define DYNARR_NAME DynArr
+#define DYNARR_TYPE int
+#define DYNARR_INT_KERNELS 1
+#endif
+
+#ifdef DYNARR_NAME
+
+#ifndef DYNARR_EQ
+#define DYNARR_EQ(A, B) ((A) == (B))
+#endif
+
+#ifndef DYNARR_LT
+#define DYNARR_LT(A, B) ((A) < (B))
+#endif
+
+#define _DYNARR_FN(verb) _DYNARR_JOIN(verb, DYNARR_NAME)
+#define _DYNARR_ITER _DYNARR_JOIN(DYNARR_NAME, Iter)
+#define _DYNARR_DATA(v) ((DYNARR_TYPE*)(v)->core.data)
+
+typedef struct DYNARR_NAME DYNARR_NAME;
+
+struct DYNARR_NAME
+{
+  struct dynArrCore core;
+};
+
+/* Iterators live on the caller's stack; initialize with init...Iter */
+struct _DYNARR_ITER
+{
+  DYNARR_NAME* array;
+  int          cur;   /* position of the next value */
+};
 
 /* Dynamic Array Functions */
-DynArr *createDynArr(int cap);
-void deleteDynArr(DynArr *v);
 
-int sizeDynArr(DynArr *v);
+static inline DYNARR_NAME* _DYNARR_FN(create)(int cap)
+{
+  DYNARR_NAME* v;
+
+  assert(cap > 0);
+  v = malloc(sizeof(DYNARR_NAME));
+  assert(v != 0);
+  initDynArrCore(&v->core, cap, sizeof(DYNARR_TYPE));
+  return v;
+}
+
+static inline void _DYNARR_FN(delete)(DYNARR_NAME* v)
+{
+  assert(v != 0);
+  free(v->core.data);
+  free(v);
+}
+
+static inline int _DYNARR_FN(size)(DYNARR_NAME* v)
+{
+  assert(v != 0);
+  return v->core.size;
+}
+
+/* Returns the elements as a plain array, valid until the next change */
+static inline DYNARR_TYPE* _DYNARR_FN(data)(DYNARR_NAME* v)
+{
+  assert(v != 0);
+  return _DYNARR_DATA(v);
+}
+
+static inline void _DYNARR_FN(add)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  assert(v != 0);
+  if (v->core.size == v->core.capacity)
+    reserveDynArrCore(&v->core, v->core.size + 1, sizeof(DYNARR_TYPE));
+  _DYNARR_DATA(v)[v->core.size++] = val;
+}
+
+/* Appends count values with one copy */
+static inline void _DYNARR_FN(addAll)(DYNARR_NAME* v,
+                                      const DYNARR_TYPE* values, int count)
+{
+  assert(v != 0);
+  assert(count >= 0);
+  reserveDynArrCore(&v->core, v->core.size + count, sizeof(DYNARR_TYPE));
+  memcpy(_DYNARR_DATA(v) + v->core.size, values,
+         sizeof(DYNARR_TYPE) * count);
+  v->core.size += count;
+}
+
+static inline DYNARR_TYPE _DYNARR_FN(get)(DYNARR_NAME* v, int pos)
+{
+  assert(v != 0);
+  assert(pos >= 0 && pos < v->core.size);
+  return _DYNARR_DATA(v)[pos];
+}
+
+static inline void _DYNARR_FN(put)(DYNARR_NAME* v, int pos, DYNARR_TYPE val)
+{
+  assert(v != 0);
+  assert(pos >= 0 && pos < v->core.size);
+  _DYNARR_DATA(v)[pos] = val;
+}
+
+static inline void _DYNARR_FN(swap)(DYNARR_NAME* v, int i, int j)
+{
+  DYNARR_TYPE temp;
+
+  assert(v != 0);
+  assert(i >= 0 && i < v->core.size);
+  assert(j >= 0 && j < v->core.size);
+  temp = _DYNARR_DATA(v)[i];
+  _DYNARR_DATA(v)[i] = _DYNARR_DATA(v)[j];
+  _DYNARR_DATA(v)[j] = temp;
+}
+
+static inline void _DYNARR_FN(removeAt)(DYNARR_NAME* v, int idx)
+{
+  assert(v != 0);
+  assert(idx >= 0 && idx < v->core.size);
+  closeDynArrCore(&v->core, idx, 1, sizeof(DYNARR_TYPE));
+}
+
+static inline void _DYNARR_FN(addAt)(DYNARR_NAME* v, int idx,
+                                     DYNARR_TYPE val)
+{
+  assert(v != 0);
+  assert(idx >= 0 && idx <= v->core.size);
+  openDynArrCore(&v->core, idx, 1, sizeof(DYNARR_TYPE));
+  _DYNARR_DATA(v)[idx] = val;
+}
 
-void addDynArr(DynArr *v, TYPE val);
-TYPE getDynArr(DynArr *v, int pos);
-void putDynArr(DynArr *v, int pos, TYPE val);
-void swapDynArr(DynArr *v, int i, int  j);
-void removeAtDynArr(DynArr *v, int idx);
-void addAtDynArr(DynArr *v, int idx, TYPE val);
+/* Removes every value, keeping the capacity for reuse */
+static inline void _DYNARR_FN(clear)(DYNARR_NAME* v)
+{
+  assert(v != 0);
+  v->core.size = 0;
+}
 
-/* Stack interface. */
-int isEmptyDynArr(DynArr *v);
-void pushDynArr(DynArr *v, TYPE val);
-TYPE topDynArr(DynArr *v);
-void popDynArr(DynArr *v);
+/* Removes every value for which match() returns true, keeping the
+   order of the rest, in one pass. Returns the number removed */
+static inline int _DYNARR_FN(removeIf)(DYNARR_NAME* v,
+                                       int (*match)(DYNARR_TYPE, void*),
+                                       void* context)
+{
+  DYNARR_TYPE* data;
+  int kept = 0,
+      removed,
+      i;
 
-/* Bag Interface */	
-int containsDynArr(DynArr *v, TYPE val);
-void removeDynArr(DynArr *v, TYPE val);
+  assert(v != 0);
+  data = _DYNARR_DATA(v);
+  for (i = 0; i < v->core.size; i++)
+    if (!match(data[i], context))
+      data[kept++] = data[i];
+  removed = v->core.size - kept;
+  v->core.size = kept;
+  shrinkDynArrCore(&v->core, sizeof(DYNARR_TYPE));
+  return removed;
+}
+
+/* Stack Interface */
+
+static inline int _DYNARR_FN(isEmpty)(DYNARR_NAME* v)
+{
+  assert(v != 0);
+  return v->core.size == 0;
+}
+
+static inline void _DYNARR_FN(push)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  _DYNARR_FN(add)(v, val);
+}
+
+static inline DYNARR_TYPE _DYNARR_FN(top)(DYNARR_NAME* v)
+{
+  assert(v != 0);
+  assert(v->core.size > 0);
+  return _DYNARR_DATA(v)[v->core.size - 1];
+}
+
+static inline void _DYNARR_FN(pop)(DYNARR_NAME* v)
+{
+  assert(v != 0);
+  assert(v->core.size > 0);
+  v->core.size--;
+  shrinkDynArrCore(&v->core, sizeof(DYNARR_TYPE));
+}
+
+/* Bag Interface */
+
+#ifdef DYNARR_INT_KERNELS
+
+_Static_assert(sizeof(DYNARR_TYPE) == sizeof(int),
+               "DYNARR_INT_KERNELS needs 32-bit elements");
+
+/* Returns the position of the first value equal to val, or -1 */
+static inline int _DYNARR_FN(indexOf)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  assert(v != 0);
+  return findIntDynArrCore((const int*)v->core.data, v->core.size, val);
+}
+
+/* Returns the number of values equal to val */
+static inline int _DYNARR_FN(count)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  assert(v != 0);
+  return countIntDynArrCore((const int*)v->core.data, v->core.size, val);
+}
+
+/* Removes every value equal to one of the count values given, keeping
+   the order of the rest, in one pass. Returns the number removed */
+static inline int _DYNARR_FN(removeAllMatching)(DYNARR_NAME* v,
+                                                const DYNARR_TYPE* values,
+                                                int count)
+{
+  int size;
+
+  assert(v != 0);
+  size = removeIntsDynArrCore((int*)v->core.data, v->core.size,
+                              (const int*)values, count);
+  count = v->core.size - size;
+  v->core.size = size;
+  shrinkDynArrCore(&v->core, sizeof(DYNARR_TYPE));
+  return count;
+}
+
+#else
+
+static inline int _DYNARR_FN(indexOf)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  DYNARR_TYPE* data;
+  int i;
+
+  assert(v != 0);
+  data = _DYNARR_DATA(v);
+  for (i = 0; i < v->core.size; i++)
+    if (DYNARR_EQ(data[i], val))
+      return i;
+  return -1;
+}
+
+static inline int _DYNARR_FN(count)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  DYNARR_TYPE* data;
+  int found = 0,
+      i;
+
+  assert(v != 0);
+  data = _DYNARR_DATA(v);
+  for (i = 0; i < v->core.size; i++)
+    if (DYNARR_EQ(data[i], val))
+      found++;
+  return found;
+}
+
+static inline int _DYNARR_FN(removeAllMatching)(DYNARR_NAME* v,
+                                                const DYNARR_TYPE* values,
+                                                int count)
+{
+  DYNARR_TYPE* data;
+  int kept = 0,
+      removed,
+      i,
+      j;
+
+  assert(v != 0);
+  data = _DYNARR_DATA(v);
+  for (i = 0; i < v->core.size; i++)
+  {
+    for (j = 0; j < count; j++)
+      if (DYNARR_EQ(data[i], values[j]))
+        break;
+    if (j == count)
+      data[kept++] = data[i];
+  }
+  removed = v->core.size - kept;
+  v->core.size = kept;
+  shrinkDynArrCore(&v->core, sizeof(DYNARR_TYPE));
+  return removed;
+}
+
+#endif
+
+static inline int _DYNARR_FN(contains)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  return _DYNARR_FN(indexOf)(v, val) != -1;
+}
+
+/* Removes the first value equal to val, which must be present */
+static inline void _DYNARR_FN(remove)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  int idx = _DYNARR_FN(indexOf)(v, val);
+
+  assert(idx != -1);
+  _DYNARR_FN(removeAt)(v, idx);
+}
 
 /* Ordered Bag Interface */
 
-void addODynArr(DynArr *v, TYPE val);
-int containsODynArr(DynArr *v, TYPE val);
-void removeODynArr(DynArr *v, TYPE val);
+/* Returns the first position whose value is not less than val */
+static inline int _DYNARR_FN(_search)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  DYNARR_TYPE* data = _DYNARR_DATA(v);
+  int low = 0,
+      high = v->core.size,
+      mid;
+
+  while (low < high)
+  {
+    mid = low + (high - low) / 2;
+    if (DYNARR_LT(data[mid], val))
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static inline void _DYNARR_FN(addO)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  assert(v != 0);
+  _DYNARR_FN(addAt)(v, _DYNARR_FN(_search)(v, val), val);
+}
+
+static inline int _DYNARR_FN(containsO)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  int idx;
+
+  assert(v != 0);
+  idx = _DYNARR_FN(_search)(v, val);
+  return idx < v->core.size && DYNARR_EQ(_DYNARR_DATA(v)[idx], val);
+}
+
+static inline void _DYNARR_FN(removeO)(DYNARR_NAME* v, DYNARR_TYPE val)
+{
+  int idx;
+
+  assert(v != 0);
+  idx = _DYNARR_FN(_search)(v, val);
+  if (idx < v->core.size && DYNARR_EQ(_DYNARR_DATA(v)[idx], val))
+    _DYNARR_FN(removeAt)(v, idx);
+}
 
 /* Iterator Interface */
 
-struct DynArrIter    *createDynArrIter(struct DynArr *v);
-void initDynArrIter(struct DynArr *v, struct DynArrIter *itr);
-int  hasNextDynArrIter(struct DynArrIter *itr);
-TYPE    nextDynArrIter(struct DynArrIter *itr);
-void	removeDynArrIter(struct DynArrIter *itr);
+static inline void _DYNARR_JOIN(init, _DYNARR_ITER)(DYNARR_NAME* v,
+                                                    struct _DYNARR_ITER* itr)
+{
+  assert(v != 0);
+  itr->array = v;
+  itr->cur = 0;
+}
+
+static inline int _DYNARR_JOIN(hasNext, _DYNARR_ITER)(struct _DYNARR_ITER* itr)
+{
+  return itr->cur < itr->array->core.size;
+}
 
-/*Bag Wrapper Interface*/
-struct bag *createBag();
-void addToBag(struct bag* b, TYPE val);
-void removeFromBag(struct bag* b, TYPE val);
-int containsBag(struct bag* b, TYPE val);
-int isEmptyBag(struct bag* b);
-void printBag(struct bag* b);
+static inline DYNARR_TYPE _DYNARR_JOIN(next, _DYNARR_ITER)(
+  struct _DYNARR_ITER* itr)
+{
+  return _DYNARR_DATA(itr->array)[itr->cur++];
+}
+
+/* Removes the value last returned by next...Iter */
+static inline void _DYNARR_JOIN(remove, _DYNARR_ITER)(
+  struct _DYNARR_ITER* itr)
+{
+  itr->cur--;
+  _DYNARR_FN(removeAt)(itr->array, itr->cur);
+}
 
 #endif
+
+#undef _DYNARR_FN
+#undef _DYNARR_ITER
+#undef _DYNARR_DATA
+#undef DYNARR_NAME
+#undef DYNARR_TYPE
+#undef DYNARR_EQ
+#undef DYNARR_LT
+#undef DYNARR_INT_KERNELS
@@ -0,0 +1,148 @@
+/*********************************************************************
+ ** Program Filename: eventLoop.c
+ ** Description: Thin layer over epoll for the shell's main loop. Each
+ ** watched descriptor carries its event kind and an id (a job's PID)
+ ** in the epoll data, so a ready event maps straight back to what it
+ ** is for without a lookup. The loop owns one timerfd for deadlines.
+ *********************************************************************/
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "eventLoop.h"
+
+#define EVENT_BATCH 64 // most epoll events taken per wait
+
+struct EventLoop
+{
+  int epollFd;  // epoll instance
+  int timerFd;  // timerfd for setEventTimer(), -1 if unavailable
+};
+
+/*********************************************************************
+ ** createEventLoop
+ ** Description: Creates the epoll instance and its timer
+ ** Parameters: none
+ *********************************************************************/
+EventLoop* createEventLoop()
+{
+  EventLoop* l;
+
+  l = malloc(sizeof(EventLoop));
+  assert(l != 0);
+  l->epollFd = epoll_create1(EPOLL_CLOEXEC);
+  assert(l->epollFd != -1);
+
+  l->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+  if (l->timerFd != -1 &&
+      watchEvent(l, l->timerFd, EVENT_TIMER, 0) == -1)
+  {
+    close(l->timerFd);
+    l->timerFd = -1;
+  }
+  return l;
+}
+
+/*********************************************************************
+ ** deleteEventLoop
+ ** Description: Closes the epoll instance and timer. Watched
+ ** descriptors are not closed
+ ** Parameters: EventLoop* l
+ *********************************************************************/
+void deleteEventLoop(EventLoop* l)
+{
+  assert(l != 0);
+  if (l->timerFd != -1)
+    close(l->timerFd);
+  close(l->epollFd);
+  free(l);
+}
+
+/*********************************************************************
+ ** watchEvent
+ ** Description: Adds a descriptor to the loop, reported as readable
+ ** with the given kind and id. Returns 0, or -1 with errno set
+ ** Parameters: EventLoop* l, int fd, int kind, int id
+ *********************************************************************/
+int watchEvent(EventLoop* l, int fd, int kind, int id)
+{
+  struct epoll_event event;
+
+  assert(l != 0);
+  event.events = EPOLLIN;
+  event.data.u64 = ((uint64_t)(uint32_t)kind << 32) | (uint32_t)id;
+  return epoll_ctl(l->epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/*********************************************************************
+ ** unwatchEvent
+ ** Description: Removes a descriptor from the loop
+ ** Parameters: EventLoop* l, int fd
+ *********************************************************************/
+void unwatchEvent(EventLoop* l, int fd)
+{
+  assert(l != 0);
+  epoll_ctl(l->epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/*********************************************************************
+ ** setEventTimer
+ ** Description: Arms the loop's timer to fire once, or disarms it
+ ** when seconds is 0
+ ** Parameters: EventLoop* l, double seconds
+ *********************************************************************/
+void setEventTimer(EventLoop* l, double seconds)
+{
+  struct itimerspec timer = { { 0, 0 }, { 0, 0 } };
+
+  assert(l != 0);
+  if (l->timerFd == -1)
+    return;
+  if (seconds > 0)
+  {
+    timer.it_value.tv_sec = (time_t)seconds;
+    timer.it_value.tv_nsec = (long)((seconds - timer.it_value.tv_sec) * 1e9);
+    if (timer.it_value.tv_sec == 0 && timer.it_value.tv_nsec == 0)
+      timer.it_value.tv_nsec = 1;
+  }
+  timerfd_settime(l->timerFd, 0, &timer, NULL);
+}
+
+/*********************************************************************
+ ** waitEvents
+ ** Description: Waits for ready descriptors and translates them into
+ ** events. A fired timer is read here so it does not stay ready
+ ** Parameters: EventLoop* l, struct event* events, int maxEvents,
+ ** int timeoutMs (-1 to wait without a limit)
+ *********************************************************************/
+int waitEvents(EventLoop* l, struct event* events, int maxEvents,
+               int timeoutMs)
+{
+  struct epoll_event ready[EVENT_BATCH];
+  uint64_t expirations;
+  int count,
+      i;
+
+  assert(l != 0);
+  if (maxEvents > EVENT_BATCH)
+    maxEvents = EVENT_BATCH;
+
+  count = epoll_wait(l->epollFd, ready, maxEvents, timeoutMs);
+  if (count == -1)
+    return 0; // EINTR: the caller checks its flags and waits again
+
+  for (i = 0; i < count; i++)
+  {
+    events[i].kind = (int)(ready[i].data.u64 >> 32);
+    events[i].id = (int)(uint32_t)ready[i].data.u64;
+    if (events[i].kind == EVENT_TIMER)
+      while (read(l->timerFd, &expirations, sizeof(expirations)) == -1 &&
+             errno == EINTR)
+        ;
+  }
+  return count;
+}
@@ -0,0 +1,38 @@
+/* 	eventLoop.h : epoll-based wait for input, job exits and timers. */
+#ifndef EVENT_LOOP_INCLUDED
+#define EVENT_LOOP_INCLUDED 1
+
+/* Event kinds */
+#define EVENT_INPUT 1  /* command input is readable */
+#define EVENT_CHILD 2  /* SIGCHLD self-pipe, some child exited */
+#define EVENT_JOB   3  /* a background job's pidfd, id is its PID */
+#define EVENT_TIMER 4  /* the loop's timer expired */
+
+struct event
+{
+  int kind;  /* one of the event kinds above */
+  int id;    /* PID for EVENT_JOB, otherwise 0 */
+};
+
+typedef struct EventLoop EventLoop;
+
+EventLoop *createEventLoop();
+void deleteEventLoop(EventLoop *l);
+
+/* Starts watching fd for input. Returns 0, or -1 if it cannot be
+   watched (regular files, for one). */
+int watchEvent(EventLoop *l, int fd, int kind, int id);
+
+/* Stops watching fd. Closing fd has the same effect. */
+void unwatchEvent(EventLoop *l, int fd);
+
+/* Arms the timer to fire once after the given seconds; 0 disarms it */
+void setEventTimer(EventLoop *l, double seconds);
+
+/* Waits up to timeoutMs (-1 for no limit) for events and stores up
+   to maxEvents of them. Returns the number stored, 0 on timeout or
+   interruption by a signal. */
+int waitEvents(EventLoop *l, struct event *events, int maxEvents,
+               int timeoutMs);
+
+#endif
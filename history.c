@@ -0,0 +1,260 @@
+/*********************************************************************
+ ** Program Filename: history.c
+ ** Description: Command history kept in a plain file, one command per
+ ** line. New lines are appended with a single O_APPEND write(), so
+ ** the file is never rewritten and several shells can share it. For
+ ** reading, the file is mapped into memory and an index of line
+ ** offsets is built on first use and extended as the file grows;
+ ** looking up line n is then one array access. Substring search runs
+ ** memmem() over the whole mapping at once rather than line by line,
+ ** and a match is turned back into a line number by binary search.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "history.h"
+
+#define DYNARR_NAME OffsetArr
+#define DYNARR_TYPE off_t
+#include "dynamicArray.h"
+
+struct History
+{
+  int        fd;         // history file, opened for appending
+  char*      map;        // the file mapped read-only, NULL until needed
+  size_t     mapLength;  // bytes mapped
+  size_t     indexedEnd; // bytes of the file covered by the index
+  OffsetArr* offsets;    // start of each complete line
+};
+
+/*********************************************************************
+ ** openHistory
+ ** Description: Opens or creates the history file. A last line left
+ ** without its newline (by a crash) is ended, so the next command
+ ** does not run on from it
+ ** Parameters: const char* path
+ *********************************************************************/
+History* openHistory(const char* path)
+{
+  History* h;
+  struct stat info;
+  char last;
+  int fd;
+
+  fd = open(path, O_RDWR|O_APPEND|O_CREAT|O_CLOEXEC, 0600);
+  if (fd == -1)
+    return NULL;
+
+  if (fstat(fd, &info) == 0 && info.st_size > 0 &&
+      pread(fd, &last, 1, info.st_size - 1) == 1 && last != '\n')
+    write(fd, "\n", 1);
+
+  h = calloc(1, sizeof(History));
+  assert(h != 0);
+  h->fd = fd;
+  h->offsets = createOffsetArr(1024);
+  return h;
+}
+
+/*********************************************************************
+ ** closeHistory
+ ** Description: Unmaps and closes the history file and frees the index
+ ** Parameters: History* h
+ *********************************************************************/
+void closeHistory(History* h)
+{
+  assert(h != 0);
+  if (h->map != NULL)
+    munmap(h->map, h->mapLength);
+  close(h->fd);
+  deleteOffsetArr(h->offsets);
+  free(h);
+}
+
+/*********************************************************************
+ ** addHistory
+ ** Description: Appends a line and its newline with one write, which
+ ** O_APPEND places at the end of the file even if another shell has
+ ** written since. The index picks it up when it is next read
+ ** Parameters: History* h, const char* line, size_t length
+ *********************************************************************/
+void addHistory(History* h, const char* line, size_t length)
+{
+  struct iovec parts[2];
+
+  assert(h != 0);
+  parts[0].iov_base = (void*)line;
+  parts[0].iov_len = length;
+  parts[1].iov_base = "\n";
+  parts[1].iov_len = 1;
+  while (writev(h->fd, parts, 2) == -1 && errno == EINTR)
+    ;
+}
+
+/*********************************************************************
+ ** _catchUp
+ ** Description: Extends the mapping to the current end of the file and
+ ** indexes the complete lines added since the last call. If the file
+ ** has shrunk (truncated by another shell or by hand), the old mapping
+ ** would reach past its end, so it is dropped and the file indexed
+ ** again from the start
+ ** Parameters: History* h
+ *********************************************************************/
+static void _catchUp(History* h)
+{
+  struct stat info;
+  size_t size;
+  char* newMap;
+  char* p;
+  char* end;
+  char* newline;
+
+  if (fstat(h->fd, &info) == -1)
+    return;
+  size = info.st_size;
+  if (size < h->indexedEnd)
+  {
+    if (h->map != NULL)
+      munmap(h->map, h->mapLength);
+    h->map = NULL;
+    h->mapLength = 0;
+    h->indexedEnd = 0;
+    clearOffsetArr(h->offsets);
+  }
+  if (size <= h->indexedEnd)
+    return;
+
+  if (size > h->mapLength)
+  {
+    if (h->map == NULL)
+      newMap = mmap(NULL, size, PROT_READ, MAP_SHARED, h->fd, 0);
+    else
+      newMap = mremap(h->map, h->mapLength, size, MREMAP_MAYMOVE);
+    if (newMap == MAP_FAILED)
+      return;
+    h->map = newMap;
+    h->mapLength = size;
+  }
+
+  p = h->map + h->indexedEnd;
+  end = h->map + size;
+  while ((newline = memchr(p, '\n', end - p)) != NULL)
+  {
+    addOffsetArr(h->offsets, p - h->map);
+    p = newline + 1;
+  }
+  h->indexedEnd = p - h->map;
+}
+
+/*********************************************************************
+ ** sizeHistory
+ ** Description: Returns the number of lines in the history
+ ** Parameters: History* h
+ *********************************************************************/
+int sizeHistory(History* h)
+{
+  assert(h != 0);
+  _catchUp(h);
+  return sizeOffsetArr(h->offsets);
+}
+
+/*********************************************************************
+ ** getHistory
+ ** Description: Returns line n of the history and its length, or NULL
+ ** if there is no such line
+ ** Parameters: History* h, int n, size_t* length
+ *********************************************************************/
+const char* getHistory(History* h, int n, size_t* length)
+{
+  off_t* offsets;
+  size_t end;
+  int count;
+
+  assert(h != 0);
+  offsets = dataOffsetArr(h->offsets);
+  count = sizeOffsetArr(h->offsets);
+  if (n < 1 || n > count)
+    return NULL;
+  end = (n < count) ? (size_t)offsets[n] : h->indexedEnd;
+  *length = end - offsets[n - 1] - 1; // less the newline
+  return h->map + offsets[n - 1];
+}
+
+/*********************************************************************
+ ** findHistoryPrefix
+ ** Description: Returns the newest line that starts with prefix, or 0
+ ** Parameters: History* h, const char* prefix, size_t length
+ *********************************************************************/
+int findHistoryPrefix(History* h, const char* prefix, size_t length)
+{
+  const char* line;
+  size_t lineLength;
+  int n;
+
+  assert(h != 0);
+  _catchUp(h);
+  for (n = sizeOffsetArr(h->offsets); n > 0; n--)
+  {
+    line = getHistory(h, n, &lineLength);
+    if (lineLength >= length && memcmp(line, prefix, length) == 0)
+      return n;
+  }
+  return 0;
+}
+
+/*********************************************************************
+ ** searchHistory
+ ** Description: Returns the first line after `after` containing text,
+ ** or 0. memmem() scans from there to the end of the index in one
+ ** call; text never holds a newline, so a match cannot span lines.
+ ** The index is not brought up to date here; sizeHistory() does that
+ ** once before a search
+ ** Parameters: History* h, const char* text, size_t length, int after
+ *********************************************************************/
+int searchHistory(History* h, const char* text, size_t length, int after)
+{
+  const char* found;
+  off_t* offsets;
+  off_t offset;
+  int count,
+      low,
+      high,
+      middle;
+
+  assert(h != 0);
+  offsets = dataOffsetArr(h->offsets);
+  count = sizeOffsetArr(h->offsets);
+  if (after < 0)
+    after = 0;
+  if (after >= count)
+    return 0;
+  if (length == 0)
+    return after + 1;
+
+  found = memmem(h->map + offsets[after],
+                 h->indexedEnd - offsets[after], text, length);
+  if (found == NULL)
+    return 0;
+
+  // Find the last line starting at or before the match
+  offset = found - h->map;
+  low = after;
+  high = count - 1;
+  while (low < high)
+  {
+    middle = low + (high - low + 1) / 2;
+    if (offsets[middle] <= offset)
+      low = middle;
+    else
+      high = middle - 1;
+  }
+  return low + 1;
+}
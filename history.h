@@ -0,0 +1,36 @@
+/* 	history.h : Persistent command history in a memory-mapped file. */
+#ifndef HISTORY_INCLUDED
+#define HISTORY_INCLUDED 1
+
+#include <stddef.h>
+
+typedef struct History History;
+
+/* Opens (creating it if needed) the history file. Returns NULL if it
+   cannot be opened. */
+History *openHistory(const char *path);
+void closeHistory(History *h);
+
+/* Appends a line (without its newline) to the end of the file */
+void addHistory(History *h, const char *line, size_t length);
+
+/* Returns the number of lines, picking up any appended since the last
+   call, including those from other shells. Lines are numbered from 1
+   to this number. */
+int sizeHistory(History *h);
+
+/* Returns line n (1 to sizeHistory()) and its length. The text is not
+   '\0'-terminated and stays valid until the next call that counts or
+   searches the lines. */
+const char *getHistory(History *h, int n, size_t *length);
+
+/* Returns the newest line starting with prefix, or 0 if none does */
+int findHistoryPrefix(History *h, const char *prefix, size_t length);
+
+/* Returns the first line after line `after` that contains text, or 0
+   if none does. Start with after = 0 and pass each result back. Only
+   the lines counted by the last sizeHistory() are searched, so the
+   file is not checked again, nor the numbering changed, per match. */
+int searchHistory(History *h, const char *text, size_t length, int after);
+
+#endif
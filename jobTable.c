@@ -0,0 +1,380 @@
+/*********************************************************************
+ ** Program Filename: jobTable.c
+ ** Description: Table of background jobs. Jobs are kept in a dense
+ ** array for iteration and indexed by PID with an open-addressing
+ ** hash (linear probing, backward-shift deletion), so lookup, insert
+ ** and remove are all O(1) no matter how many jobs are running. Also
+ ** holds the FIFO of background commands waiting for a job slot.
+ *********************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jobTable.h"
+
+#define EMPTY_SLOT -1
+
+struct JobQueue
+{
+  char** lines;      // circular buffer of queued command lines
+  int head;          // position of the oldest line
+  int size;          // number of queued lines
+  int capacity;      // capacity of the lines array
+};
+
+struct JobTable
+{
+  struct job* jobs;  // dense array of jobs
+  int size;          // number of jobs in the table
+  int capacity;      // capacity of the jobs array
+  int* slots;        // hash index: dense position or EMPTY_SLOT
+  int numSlots;      // always a power of two
+  int nextJobId;     // job number handed to the next job added
+};
+
+/*********************************************************************
+ ** _hashPID
+ ** Description: Returns the home slot of a PID (multiplicative hash)
+ ** Parameters: JobTable* t, pid_t pid
+ *********************************************************************/
+static int _hashPID(JobTable* t, pid_t pid)
+{
+  return (int)(((unsigned)pid * 2654435769u) & (unsigned)(t->numSlots - 1));
+}
+
+/*********************************************************************
+ ** _findSlot
+ ** Description: Returns the hash slot holding the PID, or the empty
+ ** slot where it would be inserted
+ ** Parameters: JobTable* t, pid_t pid
+ *********************************************************************/
+static int _findSlot(JobTable* t, pid_t pid)
+{
+  int mask = t->numSlots - 1;
+  int slot = _hashPID(t, pid);
+
+  while (t->slots[slot] != EMPTY_SLOT && t->jobs[t->slots[slot]].pid != pid)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+/*********************************************************************
+ ** _setNumSlots
+ ** Description: Rebuilds the hash index with the given number of slots
+ ** Parameters: JobTable* t, int numSlots (a power of two)
+ *********************************************************************/
+static void _setNumSlots(JobTable* t, int numSlots)
+{
+  int i;
+
+  free(t->slots);
+  t->slots = malloc(sizeof(int) * numSlots);
+  assert(t->slots != 0);
+  t->numSlots = numSlots;
+  for (i = 0; i < numSlots; i++)
+    t->slots[i] = EMPTY_SLOT;
+
+  for (i = 0; i < t->size; i++)
+    t->slots[_findSlot(t, t->jobs[i].pid)] = i;
+}
+
+/*********************************************************************
+ ** createJobTable
+ ** Description: Allocates an empty job table with room for cap jobs
+ ** Parameters: int cap
+ *********************************************************************/
+JobTable* createJobTable(int cap)
+{
+  JobTable* t;
+  int numSlots = 8;
+
+  assert(cap > 0);
+  t = malloc(sizeof(JobTable));
+  assert(t != 0);
+  t->jobs = malloc(sizeof(struct job) * cap);
+  assert(t->jobs != 0);
+  t->size = 0;
+  t->capacity = cap;
+  t->nextJobId = 1;
+
+  // Keep the index at most half full
+  while (numSlots < 2 * cap)
+    numSlots *= 2;
+  t->slots = NULL;
+  _setNumSlots(t, numSlots);
+  return t;
+}
+
+/*********************************************************************
+ ** deleteJobTable
+ ** Description: Frees the table and every job still in it
+ ** Parameters: JobTable* t
+ *********************************************************************/
+void deleteJobTable(JobTable* t)
+{
+  int i;
+
+  assert(t != 0);
+  for (i = 0; i < t->size; i++)
+    free(t->jobs[i].commandLine);
+  free(t->jobs);
+  free(t->slots);
+  free(t);
+}
+
+/*********************************************************************
+ ** sizeJobTable
+ ** Description: Returns the number of jobs in the table
+ ** Parameters: JobTable* t
+ *********************************************************************/
+int sizeJobTable(JobTable* t)
+{
+  assert(t != 0);
+  return t->size;
+}
+
+/*********************************************************************
+ ** isEmptyJobTable
+ ** Description: Returns true (1) if the table holds no jobs
+ ** Parameters: JobTable* t
+ *********************************************************************/
+int isEmptyJobTable(JobTable* t)
+{
+  assert(t != 0);
+  return !(t->size);
+}
+
+/*********************************************************************
+ ** addJob
+ ** Description: Adds a running job for the PID and returns it. The
+ ** command line is copied
+ ** Parameters: JobTable* t, pid_t pid, const char* commandLine
+ *********************************************************************/
+struct job* addJob(JobTable* t, pid_t pid, const char* commandLine)
+{
+  struct job* newJob;
+
+  assert(t != 0);
+  assert(findJob(t, pid) == NULL);
+
+  if (t->size >= t->capacity)
+  {
+    t->capacity *= 2;
+    t->jobs = realloc(t->jobs, sizeof(struct job) * t->capacity);
+    assert(t->jobs != 0);
+  }
+  if (2 * (t->size + 1) > t->numSlots)
+    _setNumSlots(t, 2 * t->numSlots);
+
+  newJob = &t->jobs[t->size];
+  newJob->pid = pid;
+  newJob->pgid = 0;
+  newJob->jobId = t->nextJobId++;
+  newJob->commandLine = strdup(commandLine != NULL ? commandLine : "");
+  assert(newJob->commandLine != 0);
+  clock_gettime(CLOCK_MONOTONIC, &newJob->startTime);
+  newJob->state = JOB_RUNNING;
+  newJob->timedFlag = 0;
+  newJob->pidFd = -1;
+
+  t->slots[_findSlot(t, pid)] = t->size;
+  t->size++;
+  return newJob;
+}
+
+/*********************************************************************
+ ** findJob
+ ** Description: Returns the job with the PID, or NULL if none
+ ** Parameters: JobTable* t, pid_t pid
+ *********************************************************************/
+struct job* findJob(JobTable* t, pid_t pid)
+{
+  int slot;
+
+  assert(t != 0);
+  slot = _findSlot(t, pid);
+  if (t->slots[slot] == EMPTY_SLOT)
+    return NULL;
+  return &t->jobs[t->slots[slot]];
+}
+
+/*********************************************************************
+ ** findJobById
+ ** Description: Returns the job with the job number, or the newest
+ ** job if jobId is 0. Job numbers are not indexed, so this scans the
+ ** table; it is only used for commands typed by the user
+ ** Parameters: JobTable* t, int jobId
+ *********************************************************************/
+struct job* findJobById(JobTable* t, int jobId)
+{
+  struct job* found = NULL;
+  int i;
+
+  assert(t != 0);
+  for (i = 0; i < t->size; i++)
+  {
+    if (jobId == 0 ? (found == NULL || t->jobs[i].jobId > found->jobId) :
+                     t->jobs[i].jobId == jobId)
+      found = &t->jobs[i];
+  }
+  return found;
+}
+
+/*********************************************************************
+ ** removeJob
+ ** Description: Removes the job with the PID if it is in the table.
+ ** The last job is moved into the freed dense position
+ ** Parameters: JobTable* t, pid_t pid
+ *********************************************************************/
+void removeJob(JobTable* t, pid_t pid)
+{
+  int mask,
+      slot,
+      next,
+      home,
+      pos,
+      last;
+
+  assert(t != 0);
+  mask = t->numSlots - 1;
+  slot = _findSlot(t, pid);
+  if (t->slots[slot] == EMPTY_SLOT)
+    return;
+  pos = t->slots[slot];
+
+  // Backward-shift the probe chain so no tombstones are needed
+  t->slots[slot] = EMPTY_SLOT;
+  next = (slot + 1) & mask;
+  while (t->slots[next] != EMPTY_SLOT)
+  {
+    home = _hashPID(t, t->jobs[t->slots[next]].pid);
+    if (((next - home) & mask) >= ((next - slot) & mask))
+    {
+      t->slots[slot] = t->slots[next];
+      t->slots[next] = EMPTY_SLOT;
+      slot = next;
+    }
+    next = (next + 1) & mask;
+  }
+
+  // Fill the gap in the dense array with the last job
+  free(t->jobs[pos].commandLine);
+  last = t->size - 1;
+  if (pos != last)
+  {
+    t->jobs[pos] = t->jobs[last];
+    t->slots[_findSlot(t, t->jobs[pos].pid)] = pos;
+  }
+  t->size--;
+
+  // Start numbering again once every job is gone
+  if (t->size == 0)
+    t->nextJobId = 1;
+}
+
+/*********************************************************************
+ ** getJobAt
+ ** Description: Returns the job at a dense position
+ ** Parameters: JobTable* t, int pos (0 <= pos < size)
+ *********************************************************************/
+struct job* getJobAt(JobTable* t, int pos)
+{
+  assert(t != 0);
+  assert(pos >= 0);
+  assert(pos < t->size);
+  return &t->jobs[pos];
+}
+
+/*********************************************************************
+ ** createJobQueue
+ ** Description: Allocates an empty queue with room for cap lines
+ ** Parameters: int cap
+ *********************************************************************/
+JobQueue* createJobQueue(int cap)
+{
+  JobQueue* q;
+
+  assert(cap > 0);
+  q = malloc(sizeof(JobQueue));
+  assert(q != 0);
+  q->lines = malloc(sizeof(char*) * cap);
+  assert(q->lines != 0);
+  q->head = 0;
+  q->size = 0;
+  q->capacity = cap;
+  return q;
+}
+
+/*********************************************************************
+ ** deleteJobQueue
+ ** Description: Frees the queue and any lines still waiting in it
+ ** Parameters: JobQueue* q
+ *********************************************************************/
+void deleteJobQueue(JobQueue* q)
+{
+  assert(q != 0);
+  while (q->size > 0)
+    free(dequeueJob(q));
+  free(q->lines);
+  free(q);
+}
+
+/*********************************************************************
+ ** sizeJobQueue
+ ** Description: Returns the number of queued command lines
+ ** Parameters: JobQueue* q
+ *********************************************************************/
+int sizeJobQueue(JobQueue* q)
+{
+  assert(q != 0);
+  return q->size;
+}
+
+/*********************************************************************
+ ** enqueueJob
+ ** Description: Adds a copy of the command line to the back of the
+ ** queue
+ ** Parameters: JobQueue* q, const char* commandLine
+ *********************************************************************/
+void enqueueJob(JobQueue* q, const char* commandLine)
+{
+  int i;
+  char** newLines;
+
+  assert(q != 0);
+  if (q->size >= q->capacity)
+  {
+    // Unwrap the circular buffer into a larger array
+    newLines = malloc(sizeof(char*) * 2 * q->capacity);
+    assert(newLines != 0);
+    for (i = 0; i < q->size; i++)
+      newLines[i] = q->lines[(q->head + i) % q->capacity];
+    free(q->lines);
+    q->lines = newLines;
+    q->head = 0;
+    q->capacity *= 2;
+  }
+
+  q->lines[(q->head + q->size) % q->capacity] = strdup(commandLine);
+  assert(q->lines[(q->head + q->size) % q->capacity] != 0);
+  q->size++;
+}
+
+/*********************************************************************
+ ** dequeueJob
+ ** Description: Removes and returns the oldest queued command line,
+ ** or NULL if the queue is empty. The caller frees the line
+ ** Parameters: JobQueue* q
+ *********************************************************************/
+char* dequeueJob(JobQueue* q)
+{
+  char* line;
+
+  assert(q != 0);
+  if (q->size == 0)
+    return NULL;
+  line = q->lines[q->head];
+  q->head = (q->head + 1) % q->capacity;
+  q->size--;
+  return line;
+}
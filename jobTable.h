@@ -0,0 +1,67 @@
+/* 	jobTable.h : Background job table indexed by process ID. */
+#ifndef JOB_TABLE_INCLUDED
+#define JOB_TABLE_INCLUDED 1
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/* Job states */
+#define JOB_RUNNING 0
+#define JOB_DONE    1
+#define JOB_STOPPED 2
+
+/* Resources used by a finished job, summed over its processes */
+struct jobUsage
+{
+  double wallSeconds;   /* launch to exit */
+  double userSeconds;   /* user CPU time */
+  double systemSeconds; /* system CPU time */
+  long   maxRSS;        /* largest resident set, in kilobytes */
+  long   minorFaults;   /* page faults served without I/O */
+  long   majorFaults;   /* page faults that needed I/O */
+};
+
+struct job
+{
+  pid_t pid;              /* process ID of the job */
+  pid_t pgid;             /* its process group, 0 if it has none */
+  int   jobId;            /* small number shown to the user */
+  char* commandLine;      /* command line that started the job */
+  struct timespec startTime; /* CLOCK_MONOTONIC time of launch */
+  int   state;            /* one of the job states above */
+  int   timedFlag;        /* set if started with the time prefix */
+  int   pidFd;            /* pidfd watched for the job's exit, or -1 */
+};
+
+typedef struct JobTable JobTable;
+
+/* Job Table Functions */
+JobTable *createJobTable(int cap);
+void deleteJobTable(JobTable *t);
+
+int sizeJobTable(JobTable *t);
+int isEmptyJobTable(JobTable *t);
+
+struct job *addJob(JobTable *t, pid_t pid, const char *commandLine);
+struct job *findJob(JobTable *t, pid_t pid);
+
+/* Returns the job with the job number, or with the highest number if
+   jobId is 0. NULL if there is no such job. */
+struct job *findJobById(JobTable *t, int jobId);
+void removeJob(JobTable *t, pid_t pid);
+
+/* Dense iteration: jobs are stored at positions 0 .. size-1. Removing
+   a job moves the last job into its position. */
+struct job *getJobAt(JobTable *t, int pos);
+
+/* Job Queue Functions: command lines waiting for a free job slot */
+typedef struct JobQueue JobQueue;
+
+JobQueue *createJobQueue(int cap);
+void deleteJobQueue(JobQueue *q);
+int sizeJobQueue(JobQueue *q);
+void enqueueJob(JobQueue *q, const char *commandLine);
+char *dequeueJob(JobQueue *q);
+
+#endif
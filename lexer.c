@@ -0,0 +1,426 @@
+/*********************************************************************
+ ** Program Filename: lexer.c
+ ** Description: Re-entrant tokenizer for command lines. One left to
+ ** right scan splits words on spaces and tabs, removes quotes and
+ ** backslash escapes, recognizes the pipe, background and redirection
+ ** operators (with an optional descriptor number, as in 2>&1), stops
+ ** at a # comment, expands variables, and tags the command word with
+ ** the built-in it names.
+ ** Words and the token array are allocated in the caller's arena.
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+
+#define MAX_FD_DIGITS 4 // longest descriptor number before < or >
+
+/*********************************************************************
+ ** classifyBuiltin
+ ** Description: Returns the built-in a word names, or BUILTIN_NONE.
+ ** Dispatches on length and first letter (the second as well where
+ ** those are shared) so at most one comparison is made
+ ** Parameters: const char* word, size_t length
+ *********************************************************************/
+int classifyBuiltin(const char* word, size_t length)
+{
+  switch (length)
+  {
+    case 1:
+      if (word[0] == '[')
+        return BUILTIN_TEST;
+      break;
+    case 2:
+      if (word[0] == 'c' && word[1] == 'd')
+        return BUILTIN_CD;
+      if (word[0] == 'f' && word[1] == 'g')
+        return BUILTIN_FG;
+      if (word[0] == 'b' && word[1] == 'g')
+        return BUILTIN_BG;
+      break;
+    case 3:
+      if (word[0] == 'p' && memcmp(word, "pwd", 3) == 0)
+        return BUILTIN_PWD;
+      if (word[0] == 's' && memcmp(word, "set", 3) == 0)
+        return BUILTIN_SET;
+      break;
+    case 4:
+      if (word[0] == 'c' && memcmp(word, "cpus", 4) == 0)
+        return BUILTIN_CPUS;
+      if (word[0] == 'e' && word[1] == 'x' && memcmp(word, "exit", 4) == 0)
+        return BUILTIN_EXIT;
+      if (word[0] == 'e' && word[1] == 'c' && memcmp(word, "echo", 4) == 0)
+        return BUILTIN_ECHO;
+      if (word[0] == 'h' && memcmp(word, "hash", 4) == 0)
+        return BUILTIN_HASH;
+      if (word[0] == 'j' && memcmp(word, "jobs", 4) == 0)
+        return BUILTIN_JOBS;
+      if (word[0] == 'n' && memcmp(word, "nice", 4) == 0)
+        return BUILTIN_NICE;
+      if (word[0] == 't' && word[1] == 'i' && memcmp(word, "time", 4) == 0)
+        return BUILTIN_TIME;
+      if (word[0] == 't' && word[1] == 'r' && memcmp(word, "true", 4) == 0)
+        return BUILTIN_TRUE;
+      if (word[0] == 't' && word[1] == 'e' && memcmp(word, "test", 4) == 0)
+        return BUILTIN_TEST;
+      break;
+    case 5:
+      if (word[0] == 'f' && memcmp(word, "false", 5) == 0)
+        return BUILTIN_FALSE;
+      if (word[0] == 'l' && memcmp(word, "limit", 5) == 0)
+        return BUILTIN_LIMIT;
+      if (word[0] == 's' && word[1] == 'l' && memcmp(word, "sleep", 5) == 0)
+        return BUILTIN_SLEEP;
+      if (word[0] == 's' && word[1] == 't' && memcmp(word, "stats", 5) == 0)
+        return BUILTIN_STATS;
+      if (word[0] == 'u' && memcmp(word, "unset", 5) == 0)
+        return BUILTIN_UNSET;
+      break;
+    case 6:
+      if (word[0] == 'e' && memcmp(word, "export", 6) == 0)
+        return BUILTIN_EXPORT;
+      if (word[0] == 'p' && memcmp(word, "printf", 6) == 0)
+        return BUILTIN_PRINTF;
+      if (word[0] == 's' && memcmp(word, "status", 6) == 0)
+        return BUILTIN_STATUS;
+      break;
+    case 7:
+      if (word[0] == 'h' && memcmp(word, "history", 7) == 0)
+        return BUILTIN_HISTORY;
+      break;
+    case 10:
+      if (word[0] == 'j' && memcmp(word, "jobs-limit", 10) == 0)
+        return BUILTIN_JOBS_LIMIT;
+      break;
+  }
+  return BUILTIN_NONE;
+}
+
+/*********************************************************************
+ ** _isNameChar
+ ** Description: Returns true (1) for letters, digits and underscores
+ ** Parameters: char c
+ *********************************************************************/
+static int _isNameChar(char c)
+{
+  return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9');
+}
+
+/*********************************************************************
+ ** _expandVariable
+ ** Description: Reads the $NAME, ${NAME}, $$ or $? at *p and returns
+ ** its value ("" if unset), moving *p past it. Returns NULL and leaves
+ ** *p alone if the $ is not followed by a name, so it stays literal
+ ** Parameters: VarTable* vars, const char** p (at the $),
+ ** const char* end
+ *********************************************************************/
+static const char* _expandVariable(VarTable* vars, const char** p,
+                                   const char* end)
+{
+  const char* name = *p + 1;
+  const char* nameEnd;
+  const char* value;
+  int braceFlag = 0;
+
+  if (name < end && *name == '{')
+  {
+    braceFlag = 1;
+    name++;
+  }
+  nameEnd = name;
+  if (nameEnd < end && (*nameEnd == '$' || *nameEnd == '?'))
+    nameEnd++;
+  else
+  {
+    while (nameEnd < end && _isNameChar(*nameEnd))
+      nameEnd++;
+    if (!isNameVarTable(name, nameEnd - name))
+      return NULL;
+  }
+  if (braceFlag)
+  {
+    if (nameEnd == end || *nameEnd != '}')
+      return NULL;
+    *p = nameEnd + 1;
+  }
+  else
+    *p = nameEnd;
+
+  value = getVarTable(vars, name, nameEnd - name);
+  return value != NULL ? value : "";
+}
+
+/*********************************************************************
+ ** _appendValue
+ ** Description: Copies an expanded value onto the word being built.
+ ** If that would leave less than the worst case the rest of the line
+ ** needs, the word is first moved to a new, larger arena buffer; the
+ ** words before it stay where they are
+ ** Parameters: Arena* arena, const char* value, size_t remaining
+ ** (bytes of the line still to scan), char** wordStart, char** out,
+ ** char** outEnd (the word, next byte and end of the buffer)
+ *********************************************************************/
+static void _appendValue(Arena* arena, const char* value, size_t remaining,
+                         char** wordStart, char** out, char** outEnd)
+{
+  size_t length = strlen(value),
+         used = *out - *wordStart,
+         size;
+  char* buffer;
+
+  if ((size_t)(*outEnd - *out) < length + 2 * remaining + 1)
+  {
+    size = 2 * (used + length + 2 * remaining + 1);
+    buffer = allocArena(arena, size);
+    memcpy(buffer, *wordStart, used);
+    *wordStart = buffer;
+    *out = buffer + used;
+    *outEnd = buffer + size;
+  }
+  memcpy(*out, value, length);
+  *out += length;
+}
+
+/*********************************************************************
+ ** lexLine
+ ** Description: Splits a line into tokens. Words are written unquoted
+ ** into one arena buffer of twice the line length (each character
+ ** plus at most one terminator per word), which only needs to grow
+ ** when a variable is expanded. Single quotes keep everything
+ ** literal, double quotes allow \\ escapes of " \\ and $, and an
+ ** unquoted backslash escapes any character. Variables are expanded
+ ** outside single quotes and the value is never split into words; a
+ ** word that is only unquoted variables with no value is dropped. A
+ ** word of unquoted digits right before < or > is the descriptor the
+ ** redirection applies to. Returns the token count, or -1 on an
+ ** unclosed quote
+ ** Parameters: Arena* arena, const char* line, size_t length,
+ ** VarTable* vars (NULL for no expansion), struct token** tokens (set
+ ** to the token array)
+ *********************************************************************/
+int lexLine(Arena* arena, const char* line, size_t length, VarTable* vars,
+            struct token** tokens)
+{
+  struct token* list;
+  int count = 0,
+      capacity = 16,
+      kind,
+      fd,
+      redirectFd = -1,     // descriptor number read before an operator
+      plainFlag,           // set while a word has no quotes or escapes
+      expandedFlag,        // set if a word has had a variable expanded
+      commandWordFlag = 1; // set while the next word is a command word
+  char* out = allocArena(arena, 2 * length + 1);
+  char* outEnd = out + 2 * length + 1;
+  char* wordStart;
+  const char* value;
+  const char* p = line;
+  const char* end = line + length;
+  char quote;
+
+  list = allocArena(arena, sizeof(struct token) * capacity);
+
+  while (1)
+  {
+    // Skip blanks between tokens
+    while (p < end && (*p == ' ' || *p == '\t'))
+      p++;
+    if (p == end || *p == '#')
+      break;
+
+    // Keep room for this token and the final TOKEN_END
+    if (count + 2 > capacity)
+    {
+      list = growArena(arena, list, sizeof(struct token) * capacity,
+                       sizeof(struct token) * capacity * 2);
+      capacity *= 2;
+    }
+
+    // Operators: the longest match wins, so <<< before << before <
+    fd = 1;
+    switch (*p)
+    {
+      case '|':
+        kind = TOKEN_PIPE;
+        p++;
+        break;
+      case '<':
+        fd = 0;
+        kind = TOKEN_IN;
+        p++;
+        if (p < end && *p == '&')
+        {
+          kind = TOKEN_DUP;
+          p++;
+        }
+        else if (p < end && *p == '<')
+        {
+          kind = TOKEN_HEREDOC;
+          p++;
+          if (p < end && *p == '<')
+          {
+            kind = TOKEN_HERESTRING;
+            p++;
+          }
+        }
+        break;
+      case '>':
+        kind = TOKEN_OUT;
+        p++;
+        if (p < end && (*p == '>' || *p == '&'))
+          kind = (*p++ == '>') ? TOKEN_APPEND : TOKEN_DUP;
+        break;
+      case '&':
+        kind = TOKEN_BACKGROUND;
+        p++;
+        if (p < end && *p == '>')
+        {
+          kind = TOKEN_OUT_ALL;
+          p++;
+          if (p < end && *p == '>')
+          {
+            kind = TOKEN_APPEND_ALL;
+            p++;
+          }
+        }
+        break;
+      default:
+        kind = TOKEN_WORD;
+        break;
+    }
+    if (kind != TOKEN_WORD)
+    {
+      list[count].kind = kind;
+      list[count].builtin = BUILTIN_NONE;
+      list[count].text = NULL;
+      list[count].length = 0;
+      list[count].fd = (redirectFd != -1) ? redirectFd : fd;
+      redirectFd = -1;
+      count++;
+      continue;
+    }
+
+    // Word: copy characters until an unquoted blank or operator
+    wordStart = out;
+    plainFlag = 1;
+    expandedFlag = 0;
+    while (p < end)
+    {
+      if (*p == ' ' || *p == '\t' || *p == '|' || *p == '<' ||
+          *p == '>' || *p == '&')
+        break;
+
+      if (*p == '\\')
+      {
+        plainFlag = 0;
+        p++;
+        if (p < end)
+          *out++ = *p++;
+      }
+      else if (*p == '\'' || *p == '"')
+      {
+        plainFlag = 0;
+        quote = *p++;
+        while (p < end && *p != quote)
+        {
+          if (quote == '"' && *p == '\\' && p + 1 < end &&
+              (p[1] == '"' || p[1] == '\\' || p[1] == '$'))
+            p++;
+          else if (quote == '"' && *p == '$' && vars != NULL &&
+                   (value = _expandVariable(vars, &p, end)) != NULL)
+          {
+            _appendValue(arena, value, end - p, &wordStart, &out, &outEnd);
+            continue;
+          }
+          *out++ = *p++;
+        }
+        if (p == end)
+          return -1;
+        p++; // closing quote
+      }
+      else if (*p == '$' && vars != NULL &&
+               (value = _expandVariable(vars, &p, end)) != NULL)
+      {
+        expandedFlag = 1;
+        _appendValue(arena, value, end - p, &wordStart, &out, &outEnd);
+      }
+      else
+        *out++ = *p++;
+    }
+    *out++ = '\0';
+
+    // A word made only of unquoted variables that were empty is gone
+    if (plainFlag && out - wordStart == 1)
+    {
+      out = wordStart;
+      continue;
+    }
+
+    // Digits touching < or > name a descriptor, not an argument
+    if (plainFlag && !expandedFlag && p < end && (*p == '<' || *p == '>') &&
+        out - wordStart - 1 <= MAX_FD_DIGITS &&
+        strspn(wordStart, "0123456789") == (size_t)(out - wordStart - 1))
+    {
+      redirectFd = atoi(wordStart);
+      out = wordStart;
+      continue;
+    }
+
+    list[count].kind = TOKEN_WORD;
+    list[count].text = wordStart;
+    list[count].length = out - wordStart - 1;
+    list[count].fd = -1;
+    list[count].builtin = BUILTIN_NONE;
+    if (commandWordFlag)
+    {
+      list[count].builtin = classifyBuiltin(wordStart, list[count].length);
+      // The word after time is a command word too
+      commandWordFlag = (list[count].builtin == BUILTIN_TIME);
+    }
+    count++;
+  }
+
+  list[count].kind = TOKEN_END;
+  list[count].builtin = BUILTIN_NONE;
+  list[count].text = NULL;
+  list[count].length = 0;
+  list[count].fd = -1;
+  *tokens = list;
+  return count;
+}
+
+/*********************************************************************
+ ** operatorText
+ ** Description: Returns how an operator token is written
+ ** Parameters: int kind
+ *********************************************************************/
+const char* operatorText(int kind)
+{
+  switch (kind)
+  {
+    case TOKEN_PIPE:       return "|";
+    case TOKEN_IN:         return "<";
+    case TOKEN_OUT:        return ">";
+    case TOKEN_BACKGROUND: return "&";
+    case TOKEN_HEREDOC:    return "<<";
+    case TOKEN_HERESTRING: return "<<<";
+    case TOKEN_APPEND:     return ">>";
+    case TOKEN_DUP:        return ">&";
+    case TOKEN_OUT_ALL:    return "&>";
+    case TOKEN_APPEND_ALL: return "&>>";
+  }
+  return "";
+}
+
+/*********************************************************************
+ ** isRedirection
+ ** Description: Returns true (1) for operators followed by a file
+ ** name, descriptor or here-document word
+ ** Parameters: int kind
+ *********************************************************************/
+int isRedirection(int kind)
+{
+  return kind != TOKEN_END && kind != TOKEN_WORD && kind != TOKEN_PIPE &&
+         kind != TOKEN_BACKGROUND;
+}
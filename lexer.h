@@ -0,0 +1,79 @@
+/* 	lexer.h : Single-pass command line tokenizer. */
+#ifndef LEXER_INCLUDED
+#define LEXER_INCLUDED 1
+
+#include <stddef.h>
+#include "arena.h"
+#include "varTable.h"
+
+/* Token kinds */
+#define TOKEN_END        0  /* end of the line */
+#define TOKEN_WORD       1  /* argument, quotes and escapes removed */
+#define TOKEN_PIPE       2  /* | */
+#define TOKEN_IN         3  /* < */
+#define TOKEN_OUT        4  /* > */
+#define TOKEN_BACKGROUND 5  /* & */
+#define TOKEN_HEREDOC    6  /* << */
+#define TOKEN_HERESTRING 7  /* <<< */
+#define TOKEN_APPEND     8  /* >> */
+#define TOKEN_DUP        9  /* >& or <& */
+#define TOKEN_OUT_ALL    10 /* &> */
+#define TOKEN_APPEND_ALL 11 /* &>> */
+
+/* Built-in commands, recognized for the first word of a line */
+#define BUILTIN_NONE       0
+#define BUILTIN_CD         1
+#define BUILTIN_STATUS     2
+#define BUILTIN_EXIT       3
+#define BUILTIN_JOBS_LIMIT 4
+#define BUILTIN_HASH       5
+#define BUILTIN_TIME       6
+#define BUILTIN_LIMIT      7
+#define BUILTIN_NICE       8
+#define BUILTIN_CPUS       9
+#define BUILTIN_JOBS      10
+#define BUILTIN_FG        11
+#define BUILTIN_BG        12
+#define BUILTIN_HISTORY   13
+#define BUILTIN_STATS     14
+#define BUILTIN_EXPORT    15
+#define BUILTIN_UNSET     16
+#define BUILTIN_SET       17
+
+/* Utilities run inside the shell when they have no pipe or '&'. They
+   are numbered consecutively, indexing the table in utilities.c */
+#define BUILTIN_ECHO      18
+#define BUILTIN_TRUE      19
+#define BUILTIN_FALSE     20
+#define BUILTIN_PWD       21
+#define BUILTIN_TEST      22  /* test and [ */
+#define BUILTIN_PRINTF    23
+#define BUILTIN_SLEEP     24
+
+struct token
+{
+  int    kind;     /* one of the token kinds above */
+  int    builtin;  /* built-in named by a command word, or NONE */
+  char*  text;     /* '\0'-terminated word, NULL for operators */
+  size_t length;   /* length of text */
+  int    fd;       /* descriptor a redirection applies to, as in 2> */
+};
+
+/* Splits a line into tokens allocated in the arena, expanding $NAME,
+   ${NAME}, $$ and $? from vars outside single quotes (vars may be
+   NULL to leave them as typed). The array always ends with a
+   TOKEN_END token. Returns the number of tokens before it, or -1 if a
+   quote is not closed. */
+int lexLine(Arena *arena, const char *line, size_t length, VarTable *vars,
+            struct token **tokens);
+
+int classifyBuiltin(const char *word, size_t length);
+
+/* Returns true (1) for tokens that take a following word as a file
+   name, descriptor or here-document */
+int isRedirection(int kind);
+
+/* Returns how an operator token is written, for error messages */
+const char *operatorText(int kind);
+
+#endif
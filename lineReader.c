@@ -0,0 +1,147 @@
+/*********************************************************************
+ ** Program Filename: lineReader.c
+ ** Description: Reads input in large blocks and hands out lines that
+ ** are split in place, so a script of many short commands costs one
+ ** read() per block instead of one per line.
+ *********************************************************************/
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "lineReader.h"
+
+struct LineReader
+{
+  int    fd;        // file descriptor read from
+  char*  buffer;    // holds buffered input plus room for a '\0'
+  size_t capacity;  // size of buffer, not counting the '\0'
+  size_t start;     // first unconsumed byte
+  size_t end;       // one past the last buffered byte
+  size_t blockSize; // bytes requested per read()
+  int    eofFlag;   // set once read() has returned 0
+};
+
+/*********************************************************************
+ ** createLineReader
+ ** Description: Allocates a reader for the file descriptor
+ ** Parameters: int fd, size_t blockSize (bytes per read)
+ *********************************************************************/
+LineReader* createLineReader(int fd, size_t blockSize)
+{
+  LineReader* r;
+
+  assert(blockSize > 0);
+  r = malloc(sizeof(LineReader));
+  assert(r != 0);
+  r->buffer = malloc(blockSize + 1);
+  assert(r->buffer != 0);
+  r->fd = fd;
+  r->capacity = blockSize;
+  r->start = 0;
+  r->end = 0;
+  r->blockSize = blockSize;
+  r->eofFlag = 0;
+  return r;
+}
+
+/*********************************************************************
+ ** deleteLineReader
+ ** Description: Frees the reader. The file descriptor is not closed
+ ** Parameters: LineReader* r
+ *********************************************************************/
+void deleteLineReader(LineReader* r)
+{
+  assert(r != 0);
+  free(r->buffer);
+  free(r);
+}
+
+/*********************************************************************
+ ** _fillLineReader
+ ** Description: Moves any partial line to the front of the buffer,
+ ** grows the buffer if the partial line fills it, and reads the next
+ ** block. Returns the number of bytes read, 0 at end of input
+ ** Parameters: LineReader* r
+ *********************************************************************/
+static ssize_t _fillLineReader(LineReader* r)
+{
+  ssize_t bytesRead;
+
+  if (r->start > 0)
+  {
+    memmove(r->buffer, r->buffer + r->start, r->end - r->start);
+    r->end -= r->start;
+    r->start = 0;
+  }
+  if (r->capacity - r->end < r->blockSize)
+  {
+    r->capacity = r->end + r->blockSize;
+    r->buffer = realloc(r->buffer, r->capacity + 1);
+    assert(r->buffer != 0);
+  }
+
+  do
+    bytesRead = read(r->fd, r->buffer + r->end, r->blockSize);
+  while (bytesRead == -1 && errno == EINTR);
+
+  if (bytesRead <= 0)
+  {
+    r->eofFlag = 1;
+    return 0;
+  }
+  r->end += bytesRead;
+  return bytesRead;
+}
+
+/*********************************************************************
+ ** readLine
+ ** Description: Returns the next line, split in place, or NULL at end
+ ** of input. A final line without a newline is still returned
+ ** Parameters: LineReader* r, size_t* length (set to the line length
+ ** if not NULL)
+ *********************************************************************/
+char* readLine(LineReader* r, size_t* length)
+{
+  char* line;
+  char* newline;
+  size_t scanned = 0;
+
+  assert(r != 0);
+  while (1)
+  {
+    line = r->buffer + r->start;
+    newline = memchr(line + scanned, '\n', r->end - r->start - scanned);
+    if (newline != NULL)
+      break;
+
+    scanned = r->end - r->start;
+    if (r->eofFlag || _fillLineReader(r) == 0)
+    {
+      if (r->start == r->end)
+        return NULL;
+      newline = r->buffer + r->end; // last line has no newline
+      line = r->buffer + r->start;
+      break;
+    }
+  }
+
+  *newline = '\0';
+  if (length != NULL)
+    *length = newline - line;
+  r->start = newline - r->buffer + (newline < r->buffer + r->end);
+  return line;
+}
+
+/*********************************************************************
+ ** hasBufferedLine
+ ** Description: Returns true (1) if readLine() can return a line
+ ** without reading more input
+ ** Parameters: LineReader* r
+ *********************************************************************/
+int hasBufferedLine(LineReader* r)
+{
+  assert(r != 0);
+  return memchr(r->buffer + r->start, '\n', r->end - r->start) != NULL;
+}
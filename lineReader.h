@@ -0,0 +1,20 @@
+/* 	lineReader.h : Block-buffered line input. */
+#ifndef LINE_READER_INCLUDED
+#define LINE_READER_INCLUDED 1
+
+#include <stddef.h>
+
+typedef struct LineReader LineReader;
+
+LineReader *createLineReader(int fd, size_t blockSize);
+void deleteLineReader(LineReader *r);
+
+/* Returns the next line with its newline replaced by '\0', or NULL at
+   end of input. The line lives in the reader's buffer and stays valid
+   until the next call. */
+char *readLine(LineReader *r, size_t *length);
+
+/* Returns true (1) if a complete line is already buffered */
+int hasBufferedLine(LineReader *r);
+
+#endif
@@ -0,0 +1,252 @@
+/*********************************************************************
+ ** Program Filename: outputWriter.c
+ ** Description: Collects the shell's messages (job notices, status,
+ ** errors, the prompt) in memory and writes them with one writev()
+ ** per prompt cycle, instead of one write() per printf/fflush pair.
+ ** Messages are formatted into fixed-size blocks that are kept for
+ ** reuse; each run of adjacent text is one iovec segment.
+ *********************************************************************/
+
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "outputWriter.h"
+
+#define OUTPUT_BLOCKS 16   // blocks filled before a forced flush
+#define OUTPUT_SEGMENTS 64 // iovecs gathered before a forced flush
+
+struct OutputWriter
+{
+  int    fd;                            // file descriptor written to
+  char*  blocks[OUTPUT_BLOCKS];         // formatted text, NULL if unused
+  size_t blockSize;                     // size of each block
+  int    currentBlock;                  // block being filled
+  size_t used;                          // bytes used in current block
+  struct iovec segments[OUTPUT_SEGMENTS]; // text waiting to be written
+  int    segmentCount;
+  size_t pending;                       // total bytes in segments
+};
+
+/*********************************************************************
+ ** createOutputWriter
+ ** Description: Allocates a writer for the file descriptor
+ ** Parameters: int fd, size_t blockSize (bytes per message block)
+ *********************************************************************/
+OutputWriter* createOutputWriter(int fd, size_t blockSize)
+{
+  OutputWriter* w;
+
+  assert(blockSize > 0);
+  w = calloc(1, sizeof(OutputWriter));
+  assert(w != 0);
+  w->blocks[0] = malloc(blockSize);
+  assert(w->blocks[0] != 0);
+  w->fd = fd;
+  w->blockSize = blockSize;
+  return w;
+}
+
+/*********************************************************************
+ ** deleteOutputWriter
+ ** Description: Frees the writer. Unflushed output is dropped and the
+ ** file descriptor is not closed
+ ** Parameters: OutputWriter* w
+ *********************************************************************/
+void deleteOutputWriter(OutputWriter* w)
+{
+  int i;
+
+  assert(w != 0);
+  for (i = 0; i < OUTPUT_BLOCKS; i++)
+    free(w->blocks[i]);
+  free(w);
+}
+
+/*********************************************************************
+ ** _addSegment
+ ** Description: Queues text for writing, extending the last segment
+ ** if the text follows on from it. The caller makes sure a segment
+ ** is free
+ ** Parameters: OutputWriter* w, const char* text, size_t length
+ *********************************************************************/
+static void _addSegment(OutputWriter* w, const char* text, size_t length)
+{
+  struct iovec* last = w->segments + w->segmentCount;
+
+  if (w->segmentCount > 0 &&
+      (char*)last[-1].iov_base + last[-1].iov_len == text)
+    last[-1].iov_len += length;
+  else
+  {
+    w->segments[w->segmentCount].iov_base = (void*)text;
+    w->segments[w->segmentCount].iov_len = length;
+    w->segmentCount++;
+  }
+  w->pending += length;
+}
+
+/*********************************************************************
+ ** _writeAll
+ ** Description: Writes a buffer directly, retrying short writes.
+ ** Returns 0 on success, -1 on error
+ ** Parameters: int fd, const char* text, size_t length
+ *********************************************************************/
+static int _writeAll(int fd, const char* text, size_t length)
+{
+  ssize_t bytesWritten;
+
+  while (length > 0)
+  {
+    bytesWritten = write(fd, text, length);
+    if (bytesWritten == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    text += bytesWritten;
+    length -= bytesWritten;
+  }
+  return 0;
+}
+
+/*********************************************************************
+ ** printOutput
+ ** Description: Formats a message into the current block. A full
+ ** block moves on to the next one; once all blocks are in use the
+ ** writer is flushed first. A message bigger than a block is written
+ ** straight through after anything already gathered
+ ** Parameters: OutputWriter* w, const char* format, ...
+ *********************************************************************/
+void printOutput(OutputWriter* w, const char* format, ...)
+{
+  va_list args;
+  char* text;
+  int length;
+
+  assert(w != 0);
+  if (w->segmentCount == OUTPUT_SEGMENTS)
+    flushOutputWriter(w);
+
+  va_start(args, format);
+  length = vsnprintf(w->blocks[w->currentBlock] + w->used,
+                     w->blockSize - w->used, format, args);
+  va_end(args);
+  if (length < 0)
+    return;
+
+  if ((size_t)length >= w->blockSize - w->used)
+  {
+    // Too big for any block: write it out on its own
+    if ((size_t)length >= w->blockSize)
+    {
+      text = malloc(length + 1);
+      assert(text != 0);
+      va_start(args, format);
+      vsnprintf(text, length + 1, format, args);
+      va_end(args);
+      flushOutputWriter(w);
+      _writeAll(w->fd, text, length);
+      free(text);
+      return;
+    }
+
+    // Start the next block, or flush and reuse the first one
+    if (w->currentBlock + 1 == OUTPUT_BLOCKS)
+      flushOutputWriter(w);
+    else
+    {
+      w->currentBlock++;
+      if (w->blocks[w->currentBlock] == NULL)
+      {
+        w->blocks[w->currentBlock] = malloc(w->blockSize);
+        assert(w->blocks[w->currentBlock] != 0);
+      }
+    }
+    w->used = 0;
+
+    va_start(args, format);
+    vsnprintf(w->blocks[w->currentBlock], w->blockSize, format, args);
+    va_end(args);
+  }
+
+  _addSegment(w, w->blocks[w->currentBlock] + w->used, length);
+  w->used += length;
+}
+
+/*********************************************************************
+ ** putOutput
+ ** Description: Queues text that lives at least until the next flush
+ ** without copying it
+ ** Parameters: OutputWriter* w, const char* text
+ *********************************************************************/
+void putOutput(OutputWriter* w, const char* text)
+{
+  assert(w != 0);
+  if (w->segmentCount == OUTPUT_SEGMENTS)
+    flushOutputWriter(w);
+  _addSegment(w, text, strlen(text));
+}
+
+/*********************************************************************
+ ** pendingOutput
+ ** Description: Returns the number of bytes waiting to be written
+ ** Parameters: OutputWriter* w
+ *********************************************************************/
+size_t pendingOutput(OutputWriter* w)
+{
+  assert(w != 0);
+  return w->pending;
+}
+
+/*********************************************************************
+ ** flushOutputWriter
+ ** Description: Writes all queued segments with writev(), picking up
+ ** after short writes, and empties the writer. Returns 0 on success,
+ ** -1 if writing failed and the rest of the output was dropped
+ ** Parameters: OutputWriter* w
+ *********************************************************************/
+int flushOutputWriter(OutputWriter* w)
+{
+  struct iovec* segment = w->segments;
+  int segmentsLeft = w->segmentCount,
+      result = 0;
+  ssize_t bytesWritten;
+
+  assert(w != 0);
+  while (segmentsLeft > 0)
+  {
+    bytesWritten = writev(w->fd, segment, segmentsLeft);
+    if (bytesWritten == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      result = -1;
+      break;
+    }
+
+    // Skip what was written, possibly ending partway into a segment
+    while (segmentsLeft > 0 && (size_t)bytesWritten >= segment->iov_len)
+    {
+      bytesWritten -= segment->iov_len;
+      segment++;
+      segmentsLeft--;
+    }
+    if (segmentsLeft > 0)
+    {
+      segment->iov_base = (char*)segment->iov_base + bytesWritten;
+      segment->iov_len -= bytesWritten;
+    }
+  }
+
+  w->segmentCount = 0;
+  w->pending = 0;
+  w->currentBlock = 0;
+  w->used = 0;
+  return result;
+}
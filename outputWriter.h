@@ -0,0 +1,28 @@
+/* 	outputWriter.h : Gathers shell messages and writes them at once. */
+#ifndef OUTPUT_WRITER_INCLUDED
+#define OUTPUT_WRITER_INCLUDED 1
+
+#include <stddef.h>
+
+typedef struct OutputWriter OutputWriter;
+
+OutputWriter *createOutputWriter(int fd, size_t blockSize);
+void deleteOutputWriter(OutputWriter *w);
+
+/* Formats a message into the writer. Nothing reaches the file
+   descriptor until flushOutputWriter(), unless the writer fills up. */
+void printOutput(OutputWriter *w, const char *format, ...)
+  __attribute__((format(printf, 2, 3)));
+
+/* Adds text without copying it, so it must outlive the next flush
+   (a string literal such as the prompt). */
+void putOutput(OutputWriter *w, const char *text);
+
+/* Returns the number of bytes waiting to be written */
+size_t pendingOutput(OutputWriter *w);
+
+/* Writes everything gathered so far with writev(). Returns 0 on
+   success, -1 if the output could not be written (it is dropped). */
+int flushOutputWriter(OutputWriter *w);
+
+#endif
@@ -0,0 +1,340 @@
+/*********************************************************************
+ ** Program Filename: pathCache.c
+ ** Description: Hash table from command name to the absolute path it
+ ** resolves to through $PATH, so a command only walks the search path
+ ** the first time it is run. The shell hands over $PATH whenever a
+ ** variable changes, so lookups never read the environment. Counts
+ ** hits and misses for the hash builtin.
+ *********************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pathCache.h"
+
+struct pathEntry
+{
+  char*    name;   // command name, NULL if the slot is empty
+  char*    path;   // absolute path the name resolves to
+  unsigned hash;   // hash of name
+  long     hits;   // times the entry has been used
+};
+
+struct PathCache
+{
+  struct pathEntry* entries; // open-addressing table
+  int   numSlots;            // always a power of two
+  int   size;                // number of names cached
+  char* searchPath;          // $PATH the entries are resolved with
+  long  hits;                // lookups answered from the cache
+  long  misses;              // lookups that walked $PATH
+};
+
+/*********************************************************************
+ ** _hashName
+ ** Description: FNV-1a hash of a command name
+ ** Parameters: const char* name
+ *********************************************************************/
+static unsigned _hashName(const char* name)
+{
+  unsigned hash = 2166136261u;
+
+  while (*name != '\0')
+  {
+    hash ^= (unsigned char)*name++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/*********************************************************************
+ ** _findSlot
+ ** Description: Returns the slot holding the name, or the empty slot
+ ** where it would be inserted
+ ** Parameters: PathCache* c, const char* name, unsigned hash
+ *********************************************************************/
+static int _findSlot(PathCache* c, const char* name, unsigned hash)
+{
+  int mask = c->numSlots - 1;
+  int slot = hash & mask;
+
+  while (c->entries[slot].name != NULL &&
+         (c->entries[slot].hash != hash ||
+          strcmp(c->entries[slot].name, name) != 0))
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+/*********************************************************************
+ ** _resolvePath
+ ** Description: Walks $PATH for an executable regular file with the
+ ** name. Returns a malloc'd absolute path, or NULL. Matches found
+ ** through a relative $PATH entry are not returned, since they change
+ ** meaning with the working directory
+ ** Parameters: const char* searchPath, const char* name
+ *********************************************************************/
+static char* _resolvePath(const char* searchPath, const char* name)
+{
+  const char* dir = searchPath;
+  const char* dirEnd;
+  size_t dirLength,
+         nameLength = strlen(name);
+  char* candidate;
+  struct stat fileInfo;
+
+  while (dir != NULL)
+  {
+    dirEnd = strchr(dir, ':');
+    dirLength = dirEnd != NULL ? (size_t)(dirEnd - dir) : strlen(dir);
+
+    if (dirLength > 0 && dir[0] == '/')
+    {
+      candidate = malloc(dirLength + nameLength + 2);
+      assert(candidate != 0);
+      memcpy(candidate, dir, dirLength);
+      candidate[dirLength] = '/';
+      memcpy(candidate + dirLength + 1, name, nameLength + 1);
+
+      if (stat(candidate, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) &&
+          access(candidate, X_OK) == 0)
+        return candidate;
+      free(candidate);
+    }
+    dir = dirEnd != NULL ? dirEnd + 1 : NULL;
+  }
+  return NULL;
+}
+
+/*********************************************************************
+ ** _setNumSlots
+ ** Description: Moves the entries into a table of the given size
+ ** Parameters: PathCache* c, int numSlots (a power of two)
+ *********************************************************************/
+static void _setNumSlots(PathCache* c, int numSlots)
+{
+  struct pathEntry* oldEntries = c->entries;
+  int oldNumSlots = c->numSlots,
+      i;
+
+  c->entries = calloc(numSlots, sizeof(struct pathEntry));
+  assert(c->entries != 0);
+  c->numSlots = numSlots;
+
+  for (i = 0; i < oldNumSlots; i++)
+    if (oldEntries[i].name != NULL)
+      c->entries[_findSlot(c, oldEntries[i].name, oldEntries[i].hash)] =
+        oldEntries[i];
+  free(oldEntries);
+}
+
+/*********************************************************************
+ ** createPathCache
+ ** Description: Allocates an empty cache with room for cap names
+ ** Parameters: int cap
+ *********************************************************************/
+PathCache* createPathCache(int cap)
+{
+  PathCache* c;
+  int numSlots = 8;
+
+  assert(cap > 0);
+  c = malloc(sizeof(PathCache));
+  assert(c != 0);
+  while (numSlots < 2 * cap)
+    numSlots *= 2;
+  c->entries = NULL;
+  c->numSlots = 0;
+  _setNumSlots(c, numSlots);
+  c->size = 0;
+  c->searchPath = NULL;
+  c->hits = 0;
+  c->misses = 0;
+  setSearchPathCache(c, NULL);
+  return c;
+}
+
+/*********************************************************************
+ ** deletePathCache
+ ** Description: Frees the cache and all its entries
+ ** Parameters: PathCache* c
+ *********************************************************************/
+void deletePathCache(PathCache* c)
+{
+  assert(c != 0);
+  clearPathCache(c);
+  free(c->entries);
+  free(c->searchPath);
+  free(c);
+}
+
+/*********************************************************************
+ ** setSearchPathCache
+ ** Description: Sets the search path, clearing the cache if it is
+ ** different from the one the entries were resolved with
+ ** Parameters: PathCache* c, const char* searchPath (NULL for the
+ ** default)
+ *********************************************************************/
+void setSearchPathCache(PathCache* c, const char* searchPath)
+{
+  assert(c != 0);
+  if (searchPath == NULL)
+    searchPath = "/bin:/usr/bin";
+  if (c->searchPath != NULL && strcmp(c->searchPath, searchPath) == 0)
+    return;
+
+  clearPathCache(c);
+  free(c->searchPath);
+  c->searchPath = strdup(searchPath);
+  assert(c->searchPath != 0);
+}
+
+/*********************************************************************
+ ** rememberPathCache
+ ** Description: Returns the cached path of the command, resolving and
+ ** storing it if needed. Returns NULL if it is not in $PATH
+ ** Parameters: PathCache* c, const char* name
+ *********************************************************************/
+const char* rememberPathCache(PathCache* c, const char* name)
+{
+  unsigned hash;
+  int slot;
+  char* path;
+
+  assert(c != 0);
+  hash = _hashName(name);
+  slot = _findSlot(c, name, hash);
+  if (c->entries[slot].name != NULL)
+    return c->entries[slot].path;
+
+  path = _resolvePath(c->searchPath, name);
+  if (path == NULL)
+    return NULL;
+
+  if (2 * (c->size + 1) > c->numSlots)
+  {
+    _setNumSlots(c, 2 * c->numSlots);
+    slot = _findSlot(c, name, hash);
+  }
+  c->entries[slot].name = strdup(name);
+  assert(c->entries[slot].name != 0);
+  c->entries[slot].path = path;
+  c->entries[slot].hash = hash;
+  c->entries[slot].hits = 0;
+  c->size++;
+  return path;
+}
+
+/*********************************************************************
+ ** lookupPathCache
+ ** Description: Returns the absolute path of the command and counts a
+ ** cache hit or miss. Returns NULL if it is not in $PATH
+ ** Parameters: PathCache* c, const char* name
+ *********************************************************************/
+const char* lookupPathCache(PathCache* c, const char* name)
+{
+  int slot;
+  const char* path;
+
+  assert(c != 0);
+  slot = _findSlot(c, name, _hashName(name));
+  if (c->entries[slot].name != NULL)
+  {
+    c->hits++;
+    c->entries[slot].hits++;
+    return c->entries[slot].path;
+  }
+
+  c->misses++;
+  path = rememberPathCache(c, name);
+  if (path != NULL)
+    c->entries[_findSlot(c, name, _hashName(name))].hits++;
+  return path;
+}
+
+/*********************************************************************
+ ** forgetPathCache
+ ** Description: Drops the entry for the name, if any, so the next
+ ** lookup walks $PATH again
+ ** Parameters: PathCache* c, const char* name
+ *********************************************************************/
+void forgetPathCache(PathCache* c, const char* name)
+{
+  int mask,
+      slot,
+      next,
+      home;
+
+  assert(c != 0);
+  mask = c->numSlots - 1;
+  slot = _findSlot(c, name, _hashName(name));
+  if (c->entries[slot].name == NULL)
+    return;
+
+  free(c->entries[slot].name);
+  free(c->entries[slot].path);
+  c->entries[slot].name = NULL;
+  c->size--;
+
+  // Backward-shift the probe chain so no tombstones are needed
+  next = (slot + 1) & mask;
+  while (c->entries[next].name != NULL)
+  {
+    home = c->entries[next].hash & mask;
+    if (((next - home) & mask) >= ((next - slot) & mask))
+    {
+      c->entries[slot] = c->entries[next];
+      c->entries[next].name = NULL;
+      slot = next;
+    }
+    next = (next + 1) & mask;
+  }
+}
+
+/*********************************************************************
+ ** clearPathCache
+ ** Description: Drops every entry. The hit and miss counters are kept
+ ** Parameters: PathCache* c
+ *********************************************************************/
+void clearPathCache(PathCache* c)
+{
+  int i;
+
+  assert(c != 0);
+  for (i = 0; i < c->numSlots; i++)
+  {
+    if (c->entries[i].name != NULL)
+    {
+      free(c->entries[i].name);
+      free(c->entries[i].path);
+      c->entries[i].name = NULL;
+    }
+  }
+  c->size = 0;
+}
+
+/*********************************************************************
+ ** printPathCache
+ ** Description: Prints each cached command with its hit count,
+ ** followed by the cache's hit and miss counters
+ ** Parameters: PathCache* c, OutputWriter* out
+ *********************************************************************/
+void printPathCache(PathCache* c, OutputWriter* out)
+{
+  int i;
+
+  assert(c != 0);
+  if (c->size == 0)
+    printOutput(out, "hash: hash table empty\n");
+  else
+  {
+    printOutput(out, "hits\tcommand\n");
+    for (i = 0; i < c->numSlots; i++)
+      if (c->entries[i].name != NULL)
+        printOutput(out, "%4ld\t%s\n", c->entries[i].hits,
+                    c->entries[i].path);
+  }
+  printOutput(out, "cache hits %ld, misses %ld\n", c->hits, c->misses);
+}
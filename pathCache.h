@@ -0,0 +1,27 @@
+/* 	pathCache.h : Cache of command names resolved through $PATH. */
+#ifndef PATH_CACHE_INCLUDED
+#define PATH_CACHE_INCLUDED 1
+
+#include "outputWriter.h"
+
+typedef struct PathCache PathCache;
+
+PathCache *createPathCache(int cap);
+void deletePathCache(PathCache *c);
+
+/* Sets the search path commands are resolved with, clearing the cache
+   if it differs from the current one. NULL means /bin:/usr/bin. */
+void setSearchPathCache(PathCache *c, const char *searchPath);
+
+/* Returns the absolute path of the command, resolving and remembering
+   it on a miss, or NULL if it is not found in the search path. */
+const char *lookupPathCache(PathCache *c, const char *name);
+
+/* Learns the path of a command without counting a hit or miss */
+const char *rememberPathCache(PathCache *c, const char *name);
+
+void forgetPathCache(PathCache *c, const char *name);
+void clearPathCache(PathCache *c);
+void printPathCache(PathCache *c, OutputWriter *out);
+
+#endif
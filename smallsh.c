@@ -3,61 +3,351 @@
  ** Author: Peter Nguyen
  ** Date: 2/28/16
  ** CS 344-400, Program 3
- ** Description: This program is a mini-shell that supports three
- ** built-in commands. All other commands are executed via fork() and
- ** exec(). It also supports redirection of input/output.
+ ** Description: This program is a mini-shell. Its built-in commands
+ ** are cd, status, exit, jobs, fg, bg, jobs-limit, hash, history,
+ ** stats, export, unset and set, plus the time, limit, nice and cpus
+ ** prefixes. Simple echo, true, false, pwd, test, printf and sleep
+ ** commands run inside the shell. All other commands are started with
+ ** posix_spawn() (or fork() and exec()). It supports pipelines, I/O
+ ** redirection, here-documents, background jobs with job control,
+ ** $ variable expansion and command history.
  *********************************************************************/
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
 #include <signal.h>
+#include <spawn.h>
+#include <termios.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/pidfd.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include "jobTable.h"
+#include "arena.h"
+#include "auditLog.h"
 #include "dynamicArray.h"
+#include "eventLoop.h"
+#include "history.h"
+#include "lexer.h"
+#include "lineReader.h"
+#include "outputWriter.h"
+#include "pathCache.h"
+#include "stats.h"
+#include "utilities.h"
+#include "varTable.h"
 
-const int MAX_LINE_LTH = 2049;
+#define ARENA_BLOCK_SIZE (1 << 16) // per-command-line memory block
+#define PIPE_BUFFER_SIZE (1 << 20) // requested size of pipeline pipes
+#define INPUT_BLOCK_SIZE (1 << 16) // bytes read from input at a time
+#define OUTPUT_BLOCK_SIZE 4096     // bytes per block of shell messages
+#define EXIT_TERM_SECONDS 2.0      // time jobs get to end after SIGTERM
+#define EXIT_KILL_SECONDS 1.0      // and after SIGKILL, before giving up
+#define EVENT_BATCH_SIZE 64        // events handled per wakeup
+#define MAX_LIMITS 16              // resource limits one command may set
+#define SAVED_FD_BASE 10           // lowest descriptor saved around utilities
+#define STATS_DUMP_SECONDS 10.0    // default interval between stats dumps
+#define AUDIT_ROTATE_BYTES (16L << 20) // default audit log size limit
 struct sigaction action;
+int forkLaunchFlag = 0; // set if SMALLSH_LAUNCH=fork, disables spawn path
+int childPipe[2];       // self-pipe written to by the SIGCHLD handler
+volatile sig_atomic_t childExitFlag = 0; // set when any child exits
+int interactiveFlag = 0;   // set if reading commands from a terminal
+LineReader* inputReader;   // command input, stdin or a script file
+OutputWriter* shellOutput; // messages, written once per prompt cycle
+EventLoop* eventLoop;      // waits on input, job pidfds and timers
+int inputWatchedFlag = 0;  // set if input is in the event loop
+Arena* commandArena;       // memory for the current command line
+JobQueue* jobQueue;        // background commands waiting for a slot
+PathCache* pathCache;      // command names resolved through $PATH
+VarTable* vars;            // shell variables, exported ones passed on
+History* history;          // command lines typed at the terminal, or NULL
+int jobLimit = 0;          // most background jobs at once, 0 = no limit
+long jobsCompleted = 0;    // background jobs done since limit was set
+struct timespec limitStartTime; // when the job limit was set
+struct jobUsage lastForegroundUsage; // resources of the last foreground
+struct jobUsage lastBackgroundUsage; // and background commands
+pid_t lastBackgroundPID = 0;
+int promptShownFlag = 0;   // set while the prompt awaits input
+int devNullFd = -1;        // dev/null, opened once for background jobs
+int jobControlFlag = 0;    // set if jobs get process groups and the tty
+pid_t shellPgid = 0;       // the shell's own process group
+pid_t terminalPgid = 0;    // terminal's foreground group at startup
+struct termios shellModes; // terminal settings restored after a job
+char* statsDumpPath = NULL; // file the stats are dumped to, or NULL
+double statsDumpSeconds;    // seconds between dumps
+long nextStatsDumpNs;       // when the next dump is due
+AuditLog* auditLog = NULL;  // record of the commands run, or NULL
+
+// Kinds of redirection
+#define REDIRECT_FILE 0 // open a file onto the descriptor
+#define REDIRECT_DUP  1 // duplicate another descriptor, or close it
+#define REDIRECT_TEXT 2 // here-document, read from an in-memory file
+
+// One redirection, applied in the order given on the command line
+struct redirect
+{
+  int    kind;     // one of the kinds above
+  int    fd;       // descriptor being redirected
+  int    flags;    // open() flags for a file
+  int    sourceFd; // descriptor copied onto fd, -1 to close fd
+  char*  text;     // file name or here-document text
+  size_t length;   // length of here-document text
+};
+
+// Settings from the time, limit, nice and cpus prefixes of a command
+struct prefixes
+{
+  int       timeFlag;      // print the resources used when it ends
+  int       controlFlag;   // set if anything must be applied in the child
+  int       limitCount;
+  int       resources[MAX_LIMITS];  // RLIMIT_* for each limit
+  rlim_t    limitValues[MAX_LIMITS];
+  int       niceFlag;
+  int       niceIncrement; // added to the shell's nice value
+  int       cpusFlag;
+  cpu_set_t cpus;          // CPUs the command may run on
+};
+
+// Names accepted by the limit prefix
+struct limitName
+{
+  const char* name;
+  int         resource;
+};
+
+struct limitName limitNames[] = {
+  { "cpu",    RLIMIT_CPU },    // seconds of CPU time
+  { "mem",    RLIMIT_AS },     // bytes of address space
+  { "data",   RLIMIT_DATA },
+  { "stack",  RLIMIT_STACK },
+  { "fsize",  RLIMIT_FSIZE },  // largest file it may write
+  { "core",   RLIMIT_CORE },
+  { "nofile", RLIMIT_NOFILE }, // open descriptors
+  { "nproc",  RLIMIT_NPROC },
+  { NULL,     0 }
+};
+
+// One command of a pipeline
+struct stage
+{
+  char** arg;         // NULL-terminated arguments
+  int    argStart;    // index of the first argument while parsing
+  struct redirect* redirects; // redirections, in command line order
+  int    redirectStart; // index of the first redirection while parsing
+  int    redirectCount;
+  int    inFd;        // read end of the pipe from the previous stage
+  int    outFd;       // write end of the pipe to the next stage
+  int    nextInFd;    // read end for the next stage, not the child's
+  int    nullInFlag;  // set if input defaults to dev/null
+  int    nullOutFlag; // set if output defaults to dev/null
+  struct prefixes* prefixes; // limits, nice value and CPUs to apply
+  pid_t  pgid;        // process group to join, 0 to start a new one
+};
 
 // Function prototypes
-int  commandPrompt(struct DynArr* list, char* statusMsg);
-void cdCommand(char* token);
-void statusCommand(char* statusMsg);
-void exitCommand(struct DynArr* list);
-void otherCommand(char* token, struct DynArr* list, char* statusMsg);
+int  commandPrompt(JobTable* jobs, char* statusMsg);
+void cdCommand(struct token* token);
+void statusCommand(struct token* token, char* statusMsg, JobTable* jobs);
+void jobsLimitCommand(struct token* token, JobTable* jobs,
+                      char* statusMsg);
+void hashCommand(struct token* token);
+void exportCommand(struct token* token);
+void unsetCommand(struct token* token);
+void setCommand(struct token* token);
+void historyCommand(struct token* token);
+char* expandHistory(char* input, size_t* length);
+void openHistoryFile();
+void statsCommand(struct token* token);
+void initStats();
+void setStatsDump(const char* path, double seconds);
+void writeStatsDump();
+void openAuditFile();
+void auditCommand(const char* event, struct stage* stages, int stageCount,
+                  pid_t pid, int backgroundFlag, struct timespec* start,
+                  const char* statusMsg);
+void auditJobEnd(struct job* job, const char* statusMsg);
+const char* redirectOperator(struct redirect* redirect);
+void jobsCommand(JobTable* jobs);
+void fgCommand(struct token* token, JobTable* jobs, char* statusMsg);
+void bgCommand(struct token* token, JobTable* jobs);
+struct job* findJobArgument(struct token* token, JobTable* jobs,
+                            const char* name);
+int  compareJobIds(const void* a, const void* b);
+void printJob(struct job* job);
+void signalJob(struct job* job, int signo);
+int  waitForeground(pid_t* pids, int count, int* status);
+void initJobControl();
+void takeTerminal();
+void startQueuedJobs(JobTable* jobs, char* statusMsg);
+char* readHereDocs(struct token* token, char* commandLine, char* lines);
+char* nextHereDocLine(char** lines);
+int  openHereDoc(const char* text, size_t length);
+int  parseRedirect(struct token* token, struct redirect* redirect);
+void openStageHereDocs(struct stage* stage);
+void closeStageHereDocs(struct stage* stage);
+void exitCommand(JobTable* jobs);
+void otherCommand(struct token* token, char* commandLine, JobTable* jobs,
+                  char* statusMsg, struct prefixes* prefixes);
+struct token* parsePrefixes(struct token* token, struct prefixes* prefixes);
+struct token* parseLimits(struct token* token, struct prefixes* prefixes);
+int  parseCpus(const char* list, cpu_set_t* cpus);
+void applyPrefixes(struct prefixes* prefixes);
+pid_t launchStage(struct stage* stage, int stageIndex, int stageCount,
+                  int backgroundFlag);
+pid_t spawnCommand(struct stage* stage, int backgroundFlag);
+pid_t forkCommand(struct stage* stage, int backgroundFlag);
+void setupChild(struct stage* stage, int backgroundFlag);
+int  isCatPassthrough(struct stage* stage);
+pid_t catCommand(struct stage* stage, int backgroundFlag);
+int  spliceAll(int inFd, int outFd);
 void getExitStatus(int status, char* statusMsg);
-void redirectOutput(char* fileName);
-void redirectInput(char* fileName);
-void checkBackgroundJobs(struct DynArr* list, char* statusMsg);
+void setForegroundStatus(int status, char* statusMsg);
+void addUsage(struct jobUsage* total, struct rusage* usage);
+void printUsage(struct jobUsage* usage);
+double secondsSince(struct timespec* start);
+void performRedirect(struct redirect* redirect);
+int  applyRedirect(struct redirect* redirect, char* errorMsg, size_t size);
+int  runsInShell(struct stage* stage);
+void utilityCommand(struct stage* stage, int builtin, char* statusMsg,
+                    struct prefixes* prefixes);
+void checkBackgroundJobs(JobTable* jobs, char* statusMsg);
+int  handleEvents(JobTable* jobs, char* statusMsg, int timeoutMs);
+void watchJob(struct job* job);
+void reapJob(JobTable* jobs, pid_t pid, char* statusMsg);
+void reportJob(JobTable* jobs, struct job* doneJob, int status,
+               struct rusage* usage, char* statusMsg);
+void catchSIGCHLD(int signo);
+void waitForInput(JobTable* jobs, char* statusMsg);
+void flushBeforeLaunch();
 
-int main()
+int main(int argc, char* argv[])
 {
-  int exitShellFlag = 0;
+  extern char** environ;
+  int exitShellFlag = 0,
+      inputFd;
   char statusMessage[256] = "no current foreground process\n";
-  struct DynArr* processList; // stores background processes
+  JobTable* jobs; // stores background processes
 
-  processList = createDynArr(10);
+  shellOutput = createOutputWriter(1, OUTPUT_BLOCK_SIZE);
+  jobs = createJobTable(16);
+  jobQueue = createJobQueue(16);
+  pathCache = createPathCache(64);
+  vars = createVarTable(64);
+  importVarTable(vars, environ);
+  setSearchPathCache(pathCache, getVarTable(vars, "PATH", 4));
+  commandArena = createArena(ARENA_BLOCK_SIZE);
+
+  // Allow the plain fork() launch path to be forced for comparison
+  if (getenv("SMALLSH_LAUNCH") && strcmp(getenv("SMALLSH_LAUNCH"), "fork") == 0)
+    forkLaunchFlag = 1;
   
-  // Define signal handler
+  // Read commands from a script file if one is given, otherwise stdin.
+  // Anything but a terminal runs in batch mode: no prompt, and messages
+  // are only written before a command starts or when the shell exits
+  inputFd = 0;
+  if (argc > 1)
+  {
+    inputFd = open(argv[1], O_RDONLY|O_CLOEXEC);
+    if (inputFd == -1)
+    {
+      printOutput(shellOutput, "smallsh: unable to open %s\n", argv[1]);
+      flushOutputWriter(shellOutput);
+      exit(1);
+    }
+  }
+  interactiveFlag = (inputFd == 0 && isatty(0));
+  inputReader = createLineReader(inputFd, INPUT_BLOCK_SIZE);
+
+  // One dev/null descriptor serves every background job
+  devNullFd = open("/dev/null", O_RDWR|O_CLOEXEC);
+  if (devNullFd == -1)
+  {
+    printOutput(shellOutput, "smallsh: unable to open /dev/null\n");
+    flushOutputWriter(shellOutput);
+    exit(1);
+  }
+
+  // Self-pipe that wakes the shell whenever a child exits. Jobs are
+  // also watched through their pidfds; the pipe catches the rest
+  if (pipe2(childPipe, O_NONBLOCK|O_CLOEXEC) == -1)
+  {
+    printOutput(shellOutput, "smallsh: pipe failed\n");
+    flushOutputWriter(shellOutput);
+    exit(1);
+  }
+  eventLoop = createEventLoop();
+  watchEvent(eventLoop, childPipe[0], EVENT_CHILD, 0);
+  if (interactiveFlag)
+    inputWatchedFlag = (watchEvent(eventLoop, 0, EVENT_INPUT, 0) == 0);
+  initStats();
+  openAuditFile();
+
+  // Define signal handlers
   action.sa_handler = SIG_IGN;
   action.sa_flags = 0;
   sigfillset(&(action.sa_mask));
   sigaction(SIGINT, &action, NULL);
 
+  // Stopped children wake the shell too, so stopped jobs are noticed
+  action.sa_handler = catchSIGCHLD;
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGCHLD, &action, NULL);
+  action.sa_flags = 0;
+
+  // At a terminal each job runs in its own process group, which is
+  // handed the terminal while it is in the foreground
+  if (interactiveFlag)
+  {
+    initJobControl();
+    openHistoryFile();
+  }
+
   // Execute the shell while command is not "exit"
-  exitShellFlag = commandPrompt(processList, statusMessage);
+  exitShellFlag = commandPrompt(jobs, statusMessage);
   while (!exitShellFlag)
   {
-    // Check for completion of any background jobs
-    if (!isEmptyDynArr(processList))
-      checkBackgroundJobs(processList, statusMessage);
+    // Report any background jobs that finished since the last prompt
+    if (childExitFlag)
+      handleEvents(jobs, statusMessage, 0);
+
+    // A dump can fall due while commands run back to back
+    if (statsDumpPath != NULL && nowStatNs() >= nextStatsDumpNs)
+      writeStatsDump();
     
-    exitShellFlag = commandPrompt(processList, statusMessage);
+    exitShellFlag = commandPrompt(jobs, statusMessage);
   }
 
-  deleteDynArr(processList);
+  if (statsDumpPath != NULL)
+    writeStatsDump();
+  free(statsDumpPath);
+
+  deleteJobTable(jobs);
+  deleteJobQueue(jobQueue);
+  deletePathCache(pathCache);
+  deleteVarTable(vars);
+  deleteArena(commandArena);
+  deleteLineReader(inputReader);
+  deleteEventLoop(eventLoop);
+  if (history != NULL)
+    closeHistory(history);
+  if (auditLog != NULL)
+    closeAuditLog(auditLog);
+  flushOutputWriter(shellOutput);
+  deleteOutputWriter(shellOutput);
+
+  // Give the terminal back to the group that had it
+  if (jobControlFlag && terminalPgid != shellPgid)
+    tcsetpgrp(0, terminalPgid);
   return 0;
 }
 
@@ -65,39 +355,121 @@ int main()
  ** commandPrompt
  ** Description: Gets the command line input from the user. Returns
  ** true (1) if the exit command was given
- ** Parameters: struct DynArr* list, char* statusMsg
+ ** Parameters: JobTable* jobs, char* statusMsg
  *********************************************************************/
-int commandPrompt(struct DynArr* processList, char* statusMsg)
+int commandPrompt(JobTable* jobs, char* statusMsg)
 {
-  char input[MAX_LINE_LTH];
-  char* token;
+  char* input;
+  struct token* token;
+  size_t length;
+  struct prefixes prefixes;
+  long startNs;
   
-  // Display command prompt and get input from user
-  printf(": ");
-  fflush(stdout);
-  fgets(input, MAX_LINE_LTH, stdin);
+  // Everything allocated for the previous command line is released
+  resetArena(commandArena);
+
+  // Display command prompt and get input from user. In batch mode
+  // there is no prompt and lines come straight from the input block
+  if (interactiveFlag)
+  {
+    putOutput(shellOutput, ": ");
+    flushOutputWriter(shellOutput);
+    if (inputWatchedFlag && !hasBufferedLine(inputReader))
+      waitForInput(jobs, statusMsg);
+  }
+  startNs = startStat();
+  input = readLine(inputReader, &length);
+  endStat(STAT_READ, startNs);
+
+  // End of input behaves like the exit command
+  if (input == NULL)
+  {
+    exitCommand(jobs);
+    return 1;
+  }
+
+  // Lines typed at the terminal are recalled with ! and recorded
+  if (history != NULL)
+  {
+    if (input[0] == '!')
+    {
+      input = expandHistory(input, &length);
+      if (input == NULL)
+        return 0;
+    }
+    if (input[strspn(input, " \t")] != '\0')
+      addHistory(history, input, length);
+  }
+
+  // Tokens go into the command arena; the line itself stays intact
+  // for the jobs table
+  startNs = startStat();
+  if (lexLine(commandArena, input, length, vars, &token) == -1)
+  {
+    printOutput(shellOutput, "smallsh: unterminated quote\n");
+    return 0;
+  }
+
+  // Prefixes such as time and nice come before the command word
+  token = parsePrefixes(token, &prefixes);
+  endStat(STAT_PARSE, startNs);
+  if (token == NULL)
+    return 0;
 
   // Check for blank lines and comments
-  if (input[0] == '\n' || input[0] == '#') 
+  if (token->kind == TOKEN_END)
     return 0;
-  else
-    input[strlen(input) - 1] = '\0'; // remove newline
 
-  token = strtok(input, " ");
+  // Here-document bodies follow the line, whichever command it is
+  input = readHereDocs(token, input, NULL);
 
-  // Check if one of the three built-in commands 
+  // Check if one of the built-in commands 
   // or some other command was input
-  if (strcmp(token, "cd") == 0)
-    cdCommand(token);
-  else if (strcmp(token, "status") == 0)
-    statusCommand(statusMsg);
-  else if (strcmp(token, "exit") == 0)
-  {  
-    exitCommand(processList);
-    return 1; // return true - exit shell
+  switch (token->builtin)
+  {
+    case BUILTIN_CD:
+      cdCommand(token);
+      break;
+    case BUILTIN_STATUS:
+      statusCommand(token, statusMsg, jobs);
+      break;
+    case BUILTIN_JOBS_LIMIT:
+      jobsLimitCommand(token, jobs, statusMsg);
+      break;
+    case BUILTIN_HASH:
+      hashCommand(token);
+      break;
+    case BUILTIN_EXPORT:
+      exportCommand(token);
+      break;
+    case BUILTIN_UNSET:
+      unsetCommand(token);
+      break;
+    case BUILTIN_SET:
+      setCommand(token);
+      break;
+    case BUILTIN_JOBS:
+      jobsCommand(jobs);
+      break;
+    case BUILTIN_FG:
+      fgCommand(token, jobs, statusMsg);
+      break;
+    case BUILTIN_BG:
+      bgCommand(token, jobs);
+      break;
+    case BUILTIN_HISTORY:
+      historyCommand(token);
+      break;
+    case BUILTIN_STATS:
+      statsCommand(token);
+      break;
+    case BUILTIN_EXIT:
+      exitCommand(jobs);
+      return 1; // return true - exit shell
+    default:
+      otherCommand(token, input, jobs, statusMsg, &prefixes);
+      break;
   }
-  else
-    otherCommand(token, processList, statusMsg);
 
   return 0;   // return false - no exit
 } 
@@ -105,297 +477,2613 @@ int commandPrompt(struct DynArr* processList, char* statusMsg)
 /*********************************************************************
  ** otherCommand
  ** Description: Executes any other commands that are not built into
- ** the shell by forking and passing it to exec function
- ** Parameters: char* token, struct DynArr* list, char* statusMsg
+ ** the shell by spawning them (or forking and passing them to exec).
+ ** Commands separated by | are run as a pipeline, one process per
+ ** stage
+ ** Parameters: struct token* token (first token of the command),
+ ** char* commandLine (the input as typed), JobTable* jobs,
+ ** char* statusMsg, struct prefixes* prefixes (from the time, limit,
+ ** nice and cpus prefixes)
  *********************************************************************/
-void otherCommand(char* token, struct DynArr* processList, char* statusMsg)
+void otherCommand(struct token* token, char* commandLine, JobTable* jobs,
+                  char* statusMsg, struct prefixes* prefixes)
 {
-  pid_t childPID,
-        endPID;
+  pid_t* childPID;
+  pid_t pgid = 0;
   int status,
       argIndex = 0,
-      outRedirectFlag = 0, // various flags set if I/O redirection
-      inRedirectFlag = 0,  // or backround process is specified
-      backgroundFlag = 0;
-  char* arg[513];
-  char  outFileName[128],
-        inFileName [128];
-
-  // Check command input for I/O redirection or background
-  // process. Otherwise, add the token to arguments array
+      argCapacity = 16,
+      redirectCount = 0,
+      redirectCapacity = 4,
+      redirectsAdded,
+      stageCount = 1,
+      stageCapacity = 4,
+      stageIndex,
+      pipeFds[2],
+      nextInFd = -1,
+      stoppedFlag,
+      builtin = token->builtin,
+      backgroundFlag = 0; // set if background process is specified
+  char** arg;
+  struct redirect* redirects;
+  struct stage* stages;
+  struct timespec startTime,
+                  auditTime;
+  struct job* newJob;
+
+  // Check command input for I/O redirection, pipes or background
+  // process. Otherwise, add the token to the current stage's arguments.
+  // The arrays live in the command arena and double as needed
+  arg = allocArena(commandArena, sizeof(char*) * argCapacity);
+  redirects = allocArena(commandArena,
+                         sizeof(struct redirect) * redirectCapacity);
+  stages = allocArena(commandArena, sizeof(struct stage) * stageCapacity);
+  stages[0].argStart = 0;
+  stages[0].redirectStart = 0;
   
-  while (token != NULL)
+  for (; token->kind != TOKEN_END; token++)
   {
-    if (strcmp(token, ">") == 0)
+    if (isRedirection(token->kind))
     {
-      outRedirectFlag = 1;
-      token = strtok(NULL, " "); // Get the output file name
-      strcpy(outFileName, token);
-    }
-    else if (strcmp(token, "<") == 0)
-    {
-      inRedirectFlag = 1;
-      token = strtok(NULL, " "); // Get the input file name
-      strcpy(inFileName, token);
+      if (token[1].kind != TOKEN_WORD) // Get the file name or text
+      {
+        printOutput(shellOutput, "smallsh: missing word after %s\n",
+                    operatorText(token->kind));
+        return;
+      }
+
+      // Keep room for the two entries &> adds
+      if (redirectCount + 2 > redirectCapacity)
+      {
+        redirects = growArena(commandArena, redirects,
+                              sizeof(struct redirect) * redirectCapacity,
+                              sizeof(struct redirect) * redirectCapacity * 2);
+        redirectCapacity *= 2;
+      }
+      redirectsAdded = parseRedirect(token, &redirects[redirectCount]);
+      if (redirectsAdded == -1)
+        return;
+      redirectCount += redirectsAdded;
+      token++;
     }
-    else if (strcmp(token, "&") == 0)
+    else if (token->kind == TOKEN_BACKGROUND)
       backgroundFlag = 1;
     else
     {
-      arg[argIndex] = token;
-      argIndex++;
+      // Keep room for this entry and the final NULL
+      if (argIndex + 2 > argCapacity)
+      {
+        arg = growArena(commandArena, arg, sizeof(char*) * argCapacity,
+                        sizeof(char*) * argCapacity * 2);
+        argCapacity *= 2;
+      }
+
+      if (token->kind == TOKEN_PIPE)
+      {
+        if (stageCount == stageCapacity)
+        {
+          stages = growArena(commandArena, stages,
+                             sizeof(struct stage) * stageCapacity,
+                             sizeof(struct stage) * stageCapacity * 2);
+          stageCapacity *= 2;
+        }
+        arg[argIndex++] = NULL; // end this stage's arguments
+        stages[stageCount].argStart = argIndex;
+        stages[stageCount].redirectStart = redirectCount;
+        stageCount++;
+      }
+      else
+        arg[argIndex++] = token->text;
     }
-    token = strtok(NULL, " ");
   }
   arg[argIndex] = NULL;
 
-  // Fork the process
+  // The arrays have stopped moving, so point into them
+  for (stageIndex = 0; stageIndex < stageCount; stageIndex++)
+  {
+    stages[stageIndex].arg = arg + stages[stageIndex].argStart;
+    stages[stageIndex].prefixes = prefixes;
+    stages[stageIndex].redirects = redirects +
+                                   stages[stageIndex].redirectStart;
+    stages[stageIndex].redirectCount = (stageIndex < stageCount - 1 ?
+      stages[stageIndex + 1].redirectStart : redirectCount) -
+      stages[stageIndex].redirectStart;
+  }
 
-  childPID = fork();
+  // Utilities run inside the shell unless they need a process of their
+  // own: in a pipeline, in the background or under limits
+  if (auditLog != NULL)
+    clock_gettime(CLOCK_REALTIME, &auditTime);
+  if (isUtility(builtin) && stageCount == 1 && !backgroundFlag &&
+      !prefixes->controlFlag && runsInShell(&stages[0]))
+  {
+    utilityCommand(&stages[0], builtin, statusMsg, prefixes);
+    if (auditLog != NULL)
+      auditCommand("command", stages, 1, 0, 0, &auditTime, statusMsg);
+    return;
+  }
 
-  switch (childPID)
+  // Hold background commands while the job limit is reached; they are
+  // started by startQueuedJobs() as running jobs finish
+  if (backgroundFlag && jobLimit > 0 && sizeJobTable(jobs) >= jobLimit)
   {
-    case -1: // Fork failure
-      printf("smallsh: fork failed\n");
-      fflush(stdout);
-      exit(1);
-      break;
+    enqueueJob(jobQueue, commandLine);
+    printOutput(shellOutput, "background job queued (%d waiting)\n",
+                sizeJobQueue(jobQueue));
+    return;
+  }
 
-    case 0: // Child: exec the command
-      if (!backgroundFlag)
+  // Launch each stage, connecting it to the next one with a pipe
+  childPID = allocArena(commandArena, sizeof(pid_t) * stageCount);
+  clock_gettime(CLOCK_MONOTONIC, &startTime);
+  for (stageIndex = 0; stageIndex < stageCount; stageIndex++)
+  {
+    stages[stageIndex].inFd = nextInFd;
+    stages[stageIndex].outFd = -1;
+    stages[stageIndex].nextInFd = -1;
+    nextInFd = -1;
+
+    if (stageIndex < stageCount - 1)
+    {
+      if (pipe2(pipeFds, O_CLOEXEC) == -1)
       {
-        action.sa_handler = SIG_DFL;
-        sigaction(SIGINT, &action, NULL);
+        printOutput(shellOutput, "smallsh: pipe failed\n");
+        flushOutputWriter(shellOutput);
+        exit(1);
       }
+      fcntl(pipeFds[1], F_SETPIPE_SZ, PIPE_BUFFER_SIZE); // best effort
+      stages[stageIndex].outFd = pipeFds[1];
+      stages[stageIndex].nextInFd = pipeFds[0];
+      nextInFd = pipeFds[0];
+    }
 
-      // Perform any I/O redirection
-      if (outRedirectFlag)
-        redirectOutput(outFileName);
+    openStageHereDocs(&stages[stageIndex]);
+    stages[stageIndex].pgid = pgid;
+    childPID[stageIndex] = launchStage(&stages[stageIndex], stageIndex,
+                                       stageCount, backgroundFlag);
 
-      if (inRedirectFlag)
-        redirectInput(inFileName);
+    // The first stage leads the job's process group. The parent sets
+    // it as well, so the group exists before later stages join it
+    if (jobControlFlag)
+    {
+      if (pgid == 0)
+        pgid = childPID[stageIndex];
+      setpgid(childPID[stageIndex], pgid);
+    }
 
-      // Redirect background process I/O to dev/null
-      if (backgroundFlag && !outRedirectFlag)
-        redirectOutput(NULL);
+    // The children hold their own copies of the pipe ends and
+    // here-documents
+    if (stages[stageIndex].inFd != -1)
+      close(stages[stageIndex].inFd);
+    if (stages[stageIndex].outFd != -1)
+      close(stages[stageIndex].outFd);
+    closeStageHereDocs(&stages[stageIndex]);
+  }
 
-      if (backgroundFlag && !inRedirectFlag)
-        redirectInput(NULL);
+  // Parent: handle background or foreground process. A pipeline is
+  // tracked by its last stage; the others are reaped silently
+  if (backgroundFlag)
+  {
+    printOutput(shellOutput, "background pid is %d\n",
+                childPID[stageCount - 1]);
+    newJob = addJob(jobs, childPID[stageCount - 1], commandLine);
+    newJob->pgid = pgid;
+    newJob->timedFlag = prefixes->timeFlag;
+    watchJob(newJob);
+    if (auditLog != NULL)
+      auditCommand("start", stages, stageCount, newJob->pid, 1, &auditTime,
+                   NULL);
+  }
+  else
+  {
+    // Wait for each child to finish, adding up what it used
+    if (jobControlFlag)
+      tcsetpgrp(0, pgid);
+    memset(&lastForegroundUsage, 0, sizeof(lastForegroundUsage));
+    status = -1;
+    stoppedFlag = waitForeground(childPID, stageCount, &status);
+    takeTerminal();
 
-      // Execute command
-      execvp(arg[0], arg);
-      // if exec fails
-      printf("smallsh: no such command\n");
-      fflush(stdout);
-      exit(1);
-      break;
+    // A stopped command becomes a job that fg and bg can resume
+    if (stoppedFlag)
+    {
+      newJob = addJob(jobs, childPID[stageCount - 1], commandLine);
+      newJob->pgid = pgid;
+      newJob->startTime = startTime;
+      newJob->timedFlag = prefixes->timeFlag;
+      newJob->state = JOB_STOPPED;
+      watchJob(newJob);
+      printJob(newJob);
+      if (auditLog != NULL)
+        auditCommand("stop", stages, stageCount, newJob->pid, 0,
+                     &auditTime, "stopped");
+      return;
+    }
 
-    default: // Parent: handle background or foreground process
-      if (backgroundFlag)
-      {
-        printf("background pid is %d\n", childPID);
-        fflush(stdout);
-        pushDynArr(processList, childPID); // store background process ID
-      }
-      else
-      {
-        endPID = waitpid(childPID, &status, 0); // wait for child
-        if (endPID != -1)                       // to finish (foreground)
-          getExitStatus(status, statusMsg);
-      }                                        
-      break;                                    
+    if (status != -1)
+      setForegroundStatus(status, statusMsg);
+    lastForegroundUsage.wallSeconds = secondsSince(&startTime);
+    if (auditLog != NULL)
+      auditCommand("command", stages, stageCount, childPID[stageCount - 1],
+                   0, &auditTime, statusMsg);
+
+    if (prefixes->timeFlag)
+      printUsage(&lastForegroundUsage);
   }
 }
 
 /*********************************************************************
- ** cdCommand
- ** Description: Executes the change directory command
- ** Parameters: char* token
+ ** parsePrefixes
+ ** Description: Reads the time, limit, nice and cpus prefixes in front
+ ** of a command, in any order, and tags the command word after them
+ ** with the built-in it names. Returns the command word, or NULL
+ ** after printing an error
+ ** Parameters: struct token* token, struct prefixes* prefixes
  *********************************************************************/
-void cdCommand(char* token)
+struct token* parsePrefixes(struct token* token, struct prefixes* prefixes)
 {
-  int status;
+  char* end;
+  long increment;
+  int builtin;
 
-  // If no argument is input, just change to home directory
-  token = strtok(NULL, " ");
-  if (token == NULL)
+  memset(prefixes, 0, sizeof(struct prefixes));
+  while (token->kind == TOKEN_WORD)
   {
-    status = chdir(getenv("HOME"));
-    if (status != 0)
+    builtin = classifyBuiltin(token->text, token->length);
+    switch (builtin)
     {
-      printf("smallsh: unable to change directory\n");
-      fflush(stdout);
+      case BUILTIN_TIME:
+        prefixes->timeFlag = 1;
+        token++;
+        break;
+
+      case BUILTIN_LIMIT:
+        token = parseLimits(token + 1, prefixes);
+        if (token == NULL)
+          return NULL;
+        break;
+
+      case BUILTIN_NICE:
+        token++;
+        increment = (token->kind == TOKEN_WORD) ?
+                    strtol(token->text, &end, 10) : 0;
+        if (token->kind != TOKEN_WORD || *end != '\0' ||
+            increment < -40 || increment > 40)
+        {
+          printOutput(shellOutput, "smallsh: nice: expected an "
+                      "increment from -40 to 40\n");
+          return NULL;
+        }
+        prefixes->niceFlag = 1;
+        prefixes->niceIncrement = (int)increment;
+        prefixes->controlFlag = 1;
+        token++;
+        break;
+
+      case BUILTIN_CPUS:
+        token++;
+        if (token->kind != TOKEN_WORD ||
+            parseCpus(token->text, &prefixes->cpus) == -1)
+        {
+          printOutput(shellOutput, "smallsh: cpus: expected a CPU list "
+                      "such as 0-3,6\n");
+          return NULL;
+        }
+        prefixes->cpusFlag = 1;
+        prefixes->controlFlag = 1;
+        token++;
+        break;
+
+      default:
+        token->builtin = builtin;
+        return token;
     }
   }
-  else
-  // Change to the specified directory
+  return token;
+}
+
+/*********************************************************************
+ ** parseLimits
+ ** Description: Reads the name=value words after limit. Values are
+ ** numbers with an optional K, M or G suffix, or unlimited. Returns
+ ** the token after them, or NULL after printing an error
+ ** Parameters: struct token* token, struct prefixes* prefixes
+ *********************************************************************/
+struct token* parseLimits(struct token* token, struct prefixes* prefixes)
+{
+  char* value;
+  char* end;
+  unsigned long long number;
+  size_t nameLength;
+  int i,
+      shift;
+
+  if (token->kind != TOKEN_WORD || strchr(token->text, '=') == NULL)
   {
-    status = chdir(token);
-    if (status != 0)
+    printOutput(shellOutput, "smallsh: limit: expected name=value\n");
+    return NULL;
+  }
+
+  for (; token->kind == TOKEN_WORD &&
+         (value = strchr(token->text, '=')) != NULL; token++)
+  {
+    // Find the resource by name
+    nameLength = value - token->text;
+    value++;
+    for (i = 0; limitNames[i].name != NULL; i++)
+      if (strlen(limitNames[i].name) == nameLength &&
+          memcmp(limitNames[i].name, token->text, nameLength) == 0)
+        break;
+    if (limitNames[i].name == NULL)
     {
-      printf("smallsh: unable to change directory\n");
-      fflush(stdout);
+      printOutput(shellOutput, "smallsh: limit: unknown resource %.*s "
+                  "(cpu, mem, data, stack, fsize, core, nofile, nproc)\n",
+                  (int)nameLength, token->text);
+      return NULL;
+    }
+    if (prefixes->limitCount == MAX_LIMITS)
+    {
+      printOutput(shellOutput, "smallsh: limit: too many limits\n");
+      return NULL;
+    }
+
+    // Parse the value and its scale
+    if (strcmp(value, "unlimited") == 0)
+      number = RLIM_INFINITY;
+    else
+    {
+      errno = 0;
+      number = strtoull(value, &end, 10);
+      shift = 0;
+      switch (*end)
+      {
+        case 'K': case 'k': shift = 10; end++; break;
+        case 'M': case 'm': shift = 20; end++; break;
+        case 'G': case 'g': shift = 30; end++; break;
+      }
+      // A scaled value too large for a finite limit would wrap
+      if (end == value || *end != '\0' || errno != 0 || *value == '-' ||
+          number > (RLIM_INFINITY - 1) >> shift)
+      {
+        printOutput(shellOutput, "smallsh: limit: invalid value %s\n",
+                    token->text);
+        return NULL;
+      }
+      number <<= shift;
     }
+
+    prefixes->resources[prefixes->limitCount] = limitNames[i].resource;
+    prefixes->limitValues[prefixes->limitCount] = (rlim_t)number;
+    prefixes->limitCount++;
   }
+  prefixes->controlFlag = 1;
+  return token;
 }
 
 /*********************************************************************
- ** exitCommand
- ** Description: Kills all running processes and exits the shell
- ** Parameters: struct DynArr* processList
+ ** parseCpus
+ ** Description: Parses a CPU list such as 0-3,6 into a CPU set.
+ ** Returns 0, or -1 if the list is malformed or empty
+ ** Parameters: const char* list, cpu_set_t* cpus
  *********************************************************************/
-void exitCommand(struct DynArr* processList)
+int parseCpus(const char* list, cpu_set_t* cpus)
 {
-  pid_t endPID;
-  int status;
-  struct DynArrIter* processIter;
-  processIter = createDynArrIter(processList);
+  char* end;
+  long first,
+       last;
 
-  initDynArrIter(processList, processIter);
-  
-  // Iterate through the jobs list and kill each process
-  if (!isEmptyDynArr(processList))
+  CPU_ZERO(cpus);
+  while (1)
   {
-    while (hasNextDynArrIter(processIter))
+    first = strtol(list, &end, 10);
+    if (end == list || first < 0 || first >= CPU_SETSIZE)
+      return -1;
+    last = first;
+    if (*end == '-')
     {
-      TYPE bgrndPID = nextDynArrIter(processIter);
-      kill(bgrndPID, SIGTERM);
-      endPID = waitpid(bgrndPID, &status, 0);
+      list = end + 1;
+      last = strtol(list, &end, 10);
+      if (end == list || last < first || last >= CPU_SETSIZE)
+        return -1;
     }
+    for (; first <= last; first++)
+      CPU_SET(first, cpus);
+
+    if (*end == '\0')
+      return 0;
+    if (*end != ',')
+      return -1;
+    list = end + 1;
   }
 }
 
 /*********************************************************************
- ** statusCommand
- ** Description: Prints the exit status or terminating signal of the
- ** last foreground process
- ** Parameters: char* statusMsg 
+ ** applyPrefixes
+ ** Description: In a forked child, sets the resource limits (both
+ ** soft and hard, so the command cannot raise them), the nice value
+ ** and the CPU set. Exits the child if any of them is refused
+ ** Parameters: struct prefixes* prefixes
  *********************************************************************/
-void statusCommand(char* statusMsg)
+void applyPrefixes(struct prefixes* prefixes)
 {
-  printf("%s", statusMsg);
-  fflush(stdout);
+  struct rlimit limit;
+  int i,
+      priority;
+
+  for (i = 0; i < prefixes->limitCount; i++)
+  {
+    limit.rlim_cur = prefixes->limitValues[i];
+    limit.rlim_max = prefixes->limitValues[i];
+    if (setrlimit(prefixes->resources[i], &limit) == -1)
+    {
+      printf("smallsh: limit: %s\n", strerror(errno));
+      fflush(stdout);
+      exit(1);
+    }
+  }
+
+  if (prefixes->niceFlag)
+  {
+    errno = 0;
+    priority = getpriority(PRIO_PROCESS, 0);
+    if (errno != 0 || setpriority(PRIO_PROCESS, 0,
+                                  priority + prefixes->niceIncrement) == -1)
+    {
+      printf("smallsh: nice: %s\n", strerror(errno));
+      fflush(stdout);
+      exit(1);
+    }
+  }
+
+  if (prefixes->cpusFlag &&
+      sched_setaffinity(0, sizeof(cpu_set_t), &prefixes->cpus) == -1)
+  {
+    printf("smallsh: cpus: %s\n", strerror(errno));
+    fflush(stdout);
+    exit(1);
+  }
 }
 
 /*********************************************************************
- ** getExitStatus 
- ** Description: Gets the exit value or termination signal of a 
- ** process and updates the current foreground status message
- ** Parameters: int status, char* statusMsg
+ ** launchStage
+ ** Description: Starts one stage of a command. A cat with no options
+ ** writing into a pipe runs as a built-in splice() passthrough.
+ ** Otherwise the spawn path is tried first; it never duplicates the
+ ** shell's address space. Any failure (bad command, unopenable file)
+ ** is retried through fork() so the child reports it as before
+ ** Parameters: struct stage* stage, int stageIndex, int stageCount,
+ ** int backgroundFlag
  *********************************************************************/
-void getExitStatus(int status, char* statusMsg)
+pid_t launchStage(struct stage* stage, int stageIndex, int stageCount,
+                  int backgroundFlag)
 {
-  if (WIFEXITED(status))
-    sprintf(statusMsg, "exit status %d\n", WEXITSTATUS(status));
-  else if (WIFSIGNALED(status))
-    sprintf(statusMsg, "terminated by signal %d\n", WTERMSIG(status));
+  pid_t childPID = -1;
+  long startNs;
+
+  flushBeforeLaunch();
+  startNs = startStat();
+
+  // Background pipelines read from and write to dev/null at the ends
+  stage->nullInFlag = backgroundFlag && stageIndex == 0;
+  stage->nullOutFlag = backgroundFlag && stageIndex == stageCount - 1;
+
+  if (isCatPassthrough(stage))
+    childPID = catCommand(stage, backgroundFlag);
   else
-    sprintf(statusMsg, "unknown status\n");
+  {
+    // Limits, nice values and CPU sets can only be applied after fork
+    if (!forkLaunchFlag && stage->arg[0] != NULL &&
+        !stage->prefixes->controlFlag)
+      childPID = spawnCommand(stage, backgroundFlag);
+    if (childPID == -1)
+      childPID = forkCommand(stage, backgroundFlag);
+  }
+  endStat(STAT_LAUNCH, startNs);
+  return childPID;
 }
 
 /*********************************************************************
- ** redirectOutput
- ** Description: Redirects output to the file name passed to it or
- ** to dev/null if no file specified and a background process
- ** Parameters: char* fileName (if NULL, dev/null is used)
+ ** spawnCommand
+ ** Description: Launches a command with posix_spawn(), which uses
+ ** vfork semantics instead of copying the shell. The program is found
+ ** through the path cache rather than by walking $PATH each time.
+ ** Pipe ends, I/O redirection and the terminal handoff are expressed
+ ** as spawn file actions, and the signal resets and process group as
+ ** spawn attributes. Returns the child PID, or -1 if the command could not
+ ** be launched this way
+ ** Parameters: struct stage* stage, int backgroundFlag
  *********************************************************************/
-void redirectOutput(char* fileName)
+pid_t spawnCommand(struct stage* stage, int backgroundFlag)
 {
-  int fileDescriptor,
-      fileDescriptor2;
-  
-  // Open file or dev/null for writing
-  if (fileName == NULL)
-    fileDescriptor = open("/dev/null", O_WRONLY);
-  else
-    fileDescriptor = open(fileName, O_WRONLY|O_CREAT|O_TRUNC, 0644);
-  if (fileDescriptor == -1)
+  pid_t childPID;
+  int result = 0,
+      i;
+  const char* path;
+  struct redirect* redirect;
+  posix_spawn_file_actions_t fileActions;
+  posix_spawnattr_t attributes;
+  sigset_t defaultSignals;
+  short spawnFlags = 0;
+
+  // Commands without a slash are resolved through the path cache
+  if (strchr(stage->arg[0], '/') != NULL)
+    path = stage->arg[0];
+  else if ((path = lookupPathCache(pathCache, stage->arg[0])) == NULL)
+    return -1;
+
+  posix_spawn_file_actions_init(&fileActions);
+  posix_spawnattr_init(&attributes);
+
+  // Foreground processes get the default SIGINT action back. Under
+  // job control every process does, since only the foreground group
+  // hears the terminal, and the stop signals are restored as well
+  sigemptyset(&defaultSignals);
+  if (!backgroundFlag || jobControlFlag)
+    sigaddset(&defaultSignals, SIGINT);
+  if (jobControlFlag)
   {
-    printf("smallsh: unable to open %s for output\n", fileName);
-    fflush(stdout);
-    exit(1);
+    sigaddset(&defaultSignals, SIGTSTP);
+    sigaddset(&defaultSignals, SIGTTIN);
+    sigaddset(&defaultSignals, SIGTTOU);
+    posix_spawnattr_setpgroup(&attributes, stage->pgid);
+    spawnFlags |= POSIX_SPAWN_SETPGROUP;
+
+    // A foreground job takes the terminal before anything else moves
+    // descriptor 0
+    if (!backgroundFlag)
+      result = posix_spawn_file_actions_addtcsetpgrp_np(&fileActions, 0);
   }
+  if (!sigisemptyset(&defaultSignals))
+  {
+    posix_spawnattr_setsigdefault(&attributes, &defaultSignals);
+    spawnFlags |= POSIX_SPAWN_SETSIGDEF;
+  }
+  posix_spawnattr_setflags(&attributes, spawnFlags);
 
-  // Redirect the output
-  fileDescriptor2 = dup2(fileDescriptor, 1);
-  if (fileDescriptor2 == -1)
+  // Same redirections as setupChild(): pipe ends first, background
+  // processes defaulting to dev/null, then redirections in order.
+  // Files are opened straight onto their descriptors
+  if (stage->outFd != -1 && result == 0)
+    result = posix_spawn_file_actions_adddup2(&fileActions, stage->outFd, 1);
+  if (stage->inFd != -1 && result == 0)
+    result = posix_spawn_file_actions_adddup2(&fileActions, stage->inFd, 0);
+  if (stage->nullOutFlag && result == 0)
+    result = posix_spawn_file_actions_adddup2(&fileActions, devNullFd, 1);
+  if (stage->nullInFlag && result == 0)
+    result = posix_spawn_file_actions_adddup2(&fileActions, devNullFd, 0);
+
+  for (i = 0; i < stage->redirectCount && result == 0; i++)
   {
-    printf("smallsh: dup2 failed\n");
-    fflush(stdout);
-    exit(2);
+    redirect = &stage->redirects[i];
+    if (redirect->kind == REDIRECT_FILE)
+      result = posix_spawn_file_actions_addopen(&fileActions, redirect->fd,
+                                                redirect->text,
+                                                redirect->flags, 0644);
+    else if (redirect->sourceFd == -1)
+      result = posix_spawn_file_actions_addclose(&fileActions,
+                                                 redirect->fd);
+    else
+      result = posix_spawn_file_actions_adddup2(&fileActions,
+                                                redirect->sourceFd,
+                                                redirect->fd);
+  }
+
+  // An action that could not be added is left to the fork path
+  if (result == 0)
+    result = posix_spawn(&childPID, path, &fileActions, &attributes,
+                         stage->arg, envpVarTable(vars));
+
+  // A cached path that no longer exists is looked up again once. Any
+  // other ENOENT, such as from a < file action, is reported as is
+  if (result == ENOENT && path != stage->arg[0] &&
+      access(path, X_OK) == -1 && errno == ENOENT)
+  {
+    forgetPathCache(pathCache, stage->arg[0]);
+    path = lookupPathCache(pathCache, stage->arg[0]);
+    if (path != NULL)
+      result = posix_spawn(&childPID, path, &fileActions, &attributes,
+                           stage->arg, envpVarTable(vars));
   }
+
+  posix_spawn_file_actions_destroy(&fileActions);
+  posix_spawnattr_destroy(&attributes);
+
+  if (result != 0)
+    return -1;
+  return childPID;
 }
 
 /*********************************************************************
- ** redirectInput
- ** Description: Redirects input to the file name passed to it or
- ** to dev/null if no file specified and a background process
- ** Parameters: char* fileName (if NULL, dev/null is used)
+ ** forkCommand
+ ** Description: Launches a command with fork() and execvp(). Used
+ ** when spawning is disabled or failed, so that the child can print
+ ** the exact reason the command could not be run
+ ** Parameters: struct stage* stage, int backgroundFlag
  *********************************************************************/
-void redirectInput(char* fileName)
+pid_t forkCommand(struct stage* stage, int backgroundFlag)
 {
-  int fileDescriptor,
-      fileDescriptor2;
-  
-  // Open file or dev/null for reading
-  if (fileName == NULL)
-    fileDescriptor = open("/dev/null", O_RDONLY);
-  else
-    fileDescriptor = open(fileName, O_RDONLY);
-  if (fileDescriptor == -1)
-  {
-    printf("smallsh: unable to open %s for input\n", fileName);
-    fflush(stdout);
-    exit(1);
-  }
+  extern char** environ;
+  pid_t childPID;
+  const char* path = NULL;
+  char** envp = envpVarTable(vars);
+  long startNs;
+
+  if (stage->arg[0] != NULL && strchr(stage->arg[0], '/') == NULL)
+    path = rememberPathCache(pathCache, stage->arg[0]);
+
+  startNs = startStat();
+  childPID = fork();
 
-  // Redirect the input
-  fileDescriptor2 = dup2(fileDescriptor, 0);
-  if (fileDescriptor2 == -1)
+  switch (childPID)
   {
-    printf("smallsh: dup2 failed\n");
-    fflush(stdout);
-    exit(2);
+    case -1: // Fork failure
+      printOutput(shellOutput, "smallsh: fork failed\n");
+      flushOutputWriter(shellOutput);
+      exit(1);
+      break;
+
+    case 0: // Child: exec the command
+      setupChild(stage, backgroundFlag);
+
+      // Execute command, from the cached path if there is one, with
+      // the shell's variables as its environment
+      environ = envp;
+      if (path != NULL)
+        execv(path, stage->arg);
+      execvp(stage->arg[0], stage->arg);
+      // if exec fails (endStat() writes to the shared stats mapping)
+      endStat(STAT_EXEC_FAIL, startNs);
+      printf("smallsh: no such command\n");
+      fflush(stdout);
+      exit(1);
+      break;
   }
+
+  return childPID;
 }
 
 /*********************************************************************
- ** checkBackgroundJobs
- ** Description: Goes through the list of background jobs and checks
- ** if each one is done. If so, prints that the job is done and
- ** the job's exit status or termination signal
- ** Parameters: struct DynArr* processList, char* statusMsg
+ ** setupChild
+ ** Description: In a forked child, joins the job's process group,
+ ** restores SIGINT for foreground processes, performs the stage's
+ ** pipe and I/O redirection and applies its resource limits, nice
+ ** value and CPU set
+ ** Parameters: struct stage* stage, int backgroundFlag
  *********************************************************************/
-void checkBackgroundJobs(struct DynArr* processList, char* statusMsg)
+void setupChild(struct stage* stage, int backgroundFlag)
 {
-  pid_t endPID;
-  int status;
-  char lastForegroundMsg[256];
-  struct DynArrIter* processIter;
-  processIter = createDynArrIter(processList);
+  int i;
 
-  // Iterate through each background process
-  initDynArrIter(processList, processIter);
-  while (hasNextDynArrIter(processIter))
+  // Take the terminal while the stop signals are still ignored, then
+  // restore them (see spawnCommand() for SIGINT under job control)
+  action.sa_handler = SIG_DFL;
+  if (jobControlFlag)
   {
-    TYPE bgrndPID = nextDynArrIter(processIter);
-    endPID = waitpid(bgrndPID, &status, WNOHANG);
+    setpgid(0, stage->pgid);
+    if (!backgroundFlag)
+      tcsetpgrp(0, getpgrp());
+    sigaction(SIGTSTP, &action, NULL);
+    sigaction(SIGTTIN, &action, NULL);
+    sigaction(SIGTTOU, &action, NULL);
+  }
+  if (!backgroundFlag || jobControlFlag)
+    sigaction(SIGINT, &action, NULL);
 
-    // Check if background process has finished
-    if (endPID == bgrndPID)
-    {
-      printf("background pid %d is done: ", bgrndPID);
-      fflush(stdout);
+  // Connect to the neighbouring stages
+  if (stage->outFd != -1)
+  {
+    dup2(stage->outFd, 1);
+    close(stage->outFd);
+  }
+  if (stage->inFd != -1)
+  {
+    dup2(stage->inFd, 0);
+    close(stage->inFd);
+  }
+  if (stage->nextInFd != -1)
+    close(stage->nextInFd);
 
-      // Print exit status and restore last foreground exit message
-      strcpy(lastForegroundMsg, statusMsg);
-      getExitStatus(status, statusMsg);
-      printf("%s", statusMsg);
-      fflush(stdout);
-      strcpy(statusMsg, lastForegroundMsg);
+  // Redirect background process I/O to dev/null
+  if (stage->nullOutFlag)
+    dup2(devNullFd, 1);
+  if (stage->nullInFlag)
+    dup2(devNullFd, 0);
 
-      removeDynArrIter(processIter); // remove job from list
-    }
-  }
+  // Perform any I/O redirection, in the order given
+  for (i = 0; i < stage->redirectCount; i++)
+    performRedirect(&stage->redirects[i]);
+
+  if (stage->prefixes->controlFlag)
+    applyPrefixes(stage->prefixes);
 }
 
+/*********************************************************************
+ ** isCatPassthrough
+ ** Description: Returns true (1) if the stage is a plain cat (file
+ ** operands only, no options) whose output is a pipe
+ ** Parameters: struct stage* stage
+ *********************************************************************/
+int isCatPassthrough(struct stage* stage)
+{
+  int i;
+
+  if (stage->arg[0] == NULL || strcmp(stage->arg[0], "cat") != 0 ||
+      stage->outFd == -1)
+    return 0;
+
+  for (i = 0; i < stage->redirectCount; i++)
+    if (stage->redirects[i].fd == 1)
+      return 0;
+
+  for (i = 1; stage->arg[i] != NULL; i++)
+    if (stage->arg[i][0] == '-' && stage->arg[i][1] != '\0')
+      return 0;
+  return 1;
+}
+
+/*********************************************************************
+ ** catCommand
+ ** Description: Built-in cat for pipeline stages. A forked child moves
+ ** each file (or its stdin) into the pipe with splice(), so the data
+ ** never passes through user space. Falls back to read()/write() if
+ ** the input cannot be spliced. Returns the child PID
+ ** Parameters: struct stage* stage, int backgroundFlag
+ *********************************************************************/
+pid_t catCommand(struct stage* stage, int backgroundFlag)
+{
+  pid_t childPID;
+  int i,
+      fileDescriptor,
+      exitValue = 0;
+
+  childPID = fork();
+
+  switch (childPID)
+  {
+    case -1: // Fork failure
+      printOutput(shellOutput, "smallsh: fork failed\n");
+      flushOutputWriter(shellOutput);
+      exit(1);
+      break;
+
+    case 0: // Child: copy each operand into the pipe
+      setupChild(stage, backgroundFlag);
+
+      if (stage->arg[1] == NULL)
+        exitValue = spliceAll(0, 1);
+      for (i = 1; stage->arg[i] != NULL; i++)
+      {
+        if (strcmp(stage->arg[i], "-") == 0)
+          fileDescriptor = 0;
+        else
+          fileDescriptor = open(stage->arg[i], O_RDONLY);
+        if (fileDescriptor == -1)
+        {
+          fprintf(stderr, "cat: %s: %s\n", stage->arg[i], strerror(errno));
+          exitValue = 1;
+          continue;
+        }
+        if (spliceAll(fileDescriptor, 1) != 0)
+          exitValue = 1;
+        if (fileDescriptor != 0)
+          close(fileDescriptor);
+      }
+      _exit(exitValue);
+      break;
+  }
+
+  return childPID;
+}
+
+/*********************************************************************
+ ** spliceAll
+ ** Description: Moves everything from inFd to outFd (a pipe) with
+ ** splice(), or with read()/write() if splicing is not supported for
+ ** inFd. Returns 0 on success, -1 on error
+ ** Parameters: int inFd, int outFd
+ *********************************************************************/
+int spliceAll(int inFd, int outFd)
+{
+  ssize_t bytesMoved,
+          bytesWritten,
+          offset;
+  char buffer[65536];
+
+  while ((bytesMoved = splice(inFd, NULL, outFd, NULL, PIPE_BUFFER_SIZE,
+                              SPLICE_F_MOVE|SPLICE_F_MORE)) > 0)
+    ;
+  if (bytesMoved == 0)
+    return 0;
+  if (errno != EINVAL)
+    return -1;
+
+  while ((bytesMoved = read(inFd, buffer, sizeof(buffer))) > 0)
+  {
+    for (offset = 0; offset < bytesMoved; offset += bytesWritten)
+    {
+      bytesWritten = write(outFd, buffer + offset, bytesMoved - offset);
+      if (bytesWritten == -1)
+        return -1;
+    }
+  }
+  return bytesMoved == 0 ? 0 : -1;
+}
+
+/*********************************************************************
+ ** cdCommand
+ ** Description: Executes the change directory command
+ ** Parameters: struct token* token
+ *********************************************************************/
+void cdCommand(struct token* token)
+{
+  const char* home;
+  int status;
+
+  // If no argument is input, just change to home directory
+  token++;
+  if (token->kind != TOKEN_WORD)
+  {
+    home = getVarTable(vars, "HOME", 4);
+    status = (home != NULL) ? chdir(home) : -1;
+    if (status != 0)
+    {
+      printOutput(shellOutput, "smallsh: unable to change directory\n");
+    }
+  }
+  else
+  // Change to the specified directory
+  {
+    status = chdir(token->text);
+    if (status != 0)
+    {
+      printOutput(shellOutput, "smallsh: unable to change directory\n");
+    }
+  }
+}
+
+/*********************************************************************
+ ** exitCommand
+ ** Description: Ends all background jobs before the shell exits. Every
+ ** job gets SIGTERM at once (stopped jobs are continued so they see
+ ** it) and they are reaped as they finish; jobs still running when
+ ** the timer fires after EXIT_TERM_SECONDS get SIGKILL
+ ** Parameters: JobTable* jobs
+ *********************************************************************/
+void exitCommand(JobTable* jobs)
+{
+  DynArr* pending; // jobs not yet reaped
+  DynArr* reaped;  // jobs reaped in this pass
+  struct event events[EVENT_BATCH_SIZE];
+  struct job* job;
+  pid_t endPID;
+  int status,
+      eventCount,
+      killedFlag = 0,
+      giveUpFlag = 0,
+      i,
+      j;
+  char drain[64],
+       exitMsg[256];
+
+  if (isEmptyJobTable(jobs))
+    return;
+
+  // Typed-ahead input would keep waking the loop
+  if (inputWatchedFlag)
+  {
+    unwatchEvent(eventLoop, 0);
+    inputWatchedFlag = 0;
+  }
+
+  // Ask every job to end at once, so shutdown takes as long as the
+  // slowest job rather than the sum of them
+  pending = createDynArr(sizeJobTable(jobs));
+  reaped = createDynArr(EVENT_BATCH_SIZE);
+  for (i = 0; i < sizeJobTable(jobs); i++)
+  {
+    job = getJobAt(jobs, i);
+    signalJob(job, SIGTERM);
+    if (job->state == JOB_STOPPED)
+      signalJob(job, SIGCONT);
+    addDynArr(pending, job->pid);
+  }
+  setEventTimer(eventLoop, EXIT_TERM_SECONDS);
+
+  while (!isEmptyDynArr(pending) && !giveUpFlag)
+  {
+    eventCount = waitEvents(eventLoop, events, EVENT_BATCH_SIZE, -1);
+    for (i = 0; i < eventCount; i++)
+    {
+      if (events[i].kind != EVENT_TIMER)
+        continue;
+
+      // Jobs still running at the deadline are killed; any that
+      // survive even that are left behind
+      if (killedFlag)
+        giveUpFlag = 1;
+      else
+      {
+        for (j = 0; j < sizeDynArr(pending); j++)
+        {
+          signalJob(findJob(jobs, getDynArr(pending, j)), SIGKILL);
+        }
+        killedFlag = 1;
+        setEventTimer(eventLoop, EXIT_KILL_SECONDS);
+      }
+      break;
+    }
+
+    // Reap whatever has ended, including untracked pipeline stages.
+    // A reaped job's pidfd is dropped so it stops being reported, and
+    // the pass's jobs leave the pending list together
+    childExitFlag = 0;
+    while (read(childPipe[0], drain, sizeof(drain)) > 0)
+      ;
+    while ((endPID = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+      job = findJob(jobs, endPID);
+      if (job == NULL)
+        continue;
+      addDynArr(reaped, endPID);
+      if (auditLog != NULL)
+      {
+        getExitStatus(status, exitMsg);
+        auditJobEnd(job, exitMsg);
+      }
+      if (job->pidFd != -1)
+      {
+        unwatchEvent(eventLoop, job->pidFd);
+        close(job->pidFd);
+        job->pidFd = -1;
+      }
+    }
+    removeAllMatchingDynArr(pending, dataDynArr(reaped), sizeDynArr(reaped));
+    clearDynArr(reaped);
+  }
+
+  setEventTimer(eventLoop, 0);
+  deleteDynArr(reaped);
+  deleteDynArr(pending);
+}
+
+/*********************************************************************
+ ** statusCommand
+ ** Description: Prints the exit status or terminating signal of the
+ ** last foreground process. When a job limit is set, also prints the
+ ** queue depth and background job throughput. With -v, also prints
+ ** the resources used by the last foreground and background commands
+ ** Parameters: struct token* token, char* statusMsg, JobTable* jobs
+ *********************************************************************/
+void statusCommand(struct token* token, char* statusMsg, JobTable* jobs)
+{
+  double seconds;
+
+  printOutput(shellOutput, "%s", statusMsg);
+  token++;
+  if (token->kind == TOKEN_WORD && strcmp(token->text, "-v") == 0)
+  {
+    printOutput(shellOutput, "last foreground: ");
+    printUsage(&lastForegroundUsage);
+    if (lastBackgroundPID != 0)
+    {
+      printOutput(shellOutput, "last background (pid %d): ",
+                  lastBackgroundPID);
+      printUsage(&lastBackgroundUsage);
+    }
+  }
+  if (jobLimit > 0)
+  {
+    seconds = secondsSince(&limitStartTime);
+    printOutput(shellOutput, "background jobs: %d running, %d queued "
+                "(limit %d), %ld done, %.1f jobs/sec\n", sizeJobTable(jobs),
+                sizeJobQueue(jobQueue), jobLimit, jobsCompleted,
+                seconds > 0 ? jobsCompleted / seconds : 0.0);
+  }
+}
+
+/*********************************************************************
+ ** jobsLimitCommand
+ ** Description: Sets the most background jobs that may run at once
+ ** (0 for no limit), or prints it if no argument is given. Background
+ ** commands beyond the limit wait in a queue
+ ** Parameters: struct token* token, JobTable* jobs, char* statusMsg
+ *********************************************************************/
+void jobsLimitCommand(struct token* token, JobTable* jobs,
+                      char* statusMsg)
+{
+  char* end;
+  long limit;
+
+  token++;
+  if (token->kind != TOKEN_WORD)
+  {
+    printOutput(shellOutput, "jobs-limit %d\n", jobLimit);
+    return;
+  }
+
+  limit = strtol(token->text, &end, 10);
+  if (*end != '\0' || limit < 0 || limit > 1000000)
+  {
+    printOutput(shellOutput, "smallsh: jobs-limit: invalid limit %s\n",
+                token->text);
+    return;
+  }
+
+  // Throughput is measured from the time the limit is set
+  jobLimit = (int)limit;
+  jobsCompleted = 0;
+  clock_gettime(CLOCK_MONOTONIC, &limitStartTime);
+
+  startQueuedJobs(jobs, statusMsg);
+}
+
+/*********************************************************************
+ ** hashCommand
+ ** Description: With no arguments, lists the cached command paths
+ ** and the cache's hit and miss counters. -r clears the cache; any
+ ** other arguments are looked up and remembered
+ ** Parameters: struct token* token
+ *********************************************************************/
+void hashCommand(struct token* token)
+{
+  token++;
+  if (token->kind != TOKEN_WORD)
+    printPathCache(pathCache, shellOutput);
+  else if (strcmp(token->text, "-r") == 0)
+    clearPathCache(pathCache);
+  else
+  {
+    for (; token->kind == TOKEN_WORD; token++)
+    {
+      if (rememberPathCache(pathCache, token->text) == NULL)
+        printOutput(shellOutput, "smallsh: hash: %s: not found\n",
+                    token->text);
+    }
+  }
+}
+
+/*********************************************************************
+ ** exportCommand
+ ** Description: Marks each NAME for export to the commands the shell
+ ** runs, setting it first if given as NAME=value. With no arguments,
+ ** lists the exported variables
+ ** Parameters: struct token* token
+ *********************************************************************/
+void exportCommand(struct token* token)
+{
+  char* equals;
+  size_t nameLength;
+
+  token++;
+  if (token->kind != TOKEN_WORD)
+    printVarTable(vars, shellOutput, "export ", 1);
+  for (; token->kind == TOKEN_WORD; token++)
+  {
+    equals = strchr(token->text, '=');
+    nameLength = (equals != NULL) ? (size_t)(equals - token->text) :
+                                    token->length;
+    if ((equals != NULL &&
+         setVarTable(vars, token->text, nameLength, equals + 1) == -1) ||
+        exportVarTable(vars, token->text, nameLength) == -1)
+      printOutput(shellOutput, "smallsh: export: %s: not a valid "
+                  "identifier\n", token->text);
+  }
+  setSearchPathCache(pathCache, getVarTable(vars, "PATH", 4));
+}
+
+/*********************************************************************
+ ** unsetCommand
+ ** Description: Removes each named variable
+ ** Parameters: struct token* token
+ *********************************************************************/
+void unsetCommand(struct token* token)
+{
+  for (token++; token->kind == TOKEN_WORD; token++)
+  {
+    if (isNameVarTable(token->text, token->length))
+      unsetVarTable(vars, token->text, token->length);
+    else
+      printOutput(shellOutput, "smallsh: unset: %s: not a valid "
+                  "identifier\n", token->text);
+  }
+  setSearchPathCache(pathCache, getVarTable(vars, "PATH", 4));
+}
+
+/*********************************************************************
+ ** setCommand
+ ** Description: Sets each NAME=value as a shell variable, which is
+ ** only passed to commands if exported. With no arguments, lists
+ ** every variable
+ ** Parameters: struct token* token
+ *********************************************************************/
+void setCommand(struct token* token)
+{
+  char* equals;
+
+  token++;
+  if (token->kind != TOKEN_WORD)
+    printVarTable(vars, shellOutput, "", 0);
+  for (; token->kind == TOKEN_WORD; token++)
+  {
+    equals = strchr(token->text, '=');
+    if (equals == NULL)
+      printOutput(shellOutput, "smallsh: set: expected name=value\n");
+    else if (setVarTable(vars, token->text, equals - token->text,
+                         equals + 1) == -1)
+      printOutput(shellOutput, "smallsh: set: %s: not a valid "
+                  "identifier\n", token->text);
+  }
+  setSearchPathCache(pathCache, getVarTable(vars, "PATH", 4));
+}
+
+/*********************************************************************
+ ** historyCommand
+ ** Description: Lists the command history, or its last n lines with a
+ ** number. -s text lists only the lines that contain text
+ ** Parameters: struct token* token
+ *********************************************************************/
+void historyCommand(struct token* token)
+{
+  const char* line;
+  char* end;
+  size_t lineLength;
+  long count;
+  int n,
+      size;
+
+  if (history == NULL)
+  {
+    printOutput(shellOutput, "smallsh: history: not available\n");
+    return;
+  }
+
+  token++;
+  if (token->kind == TOKEN_WORD && strcmp(token->text, "-s") == 0)
+  {
+    token++;
+    if (token->kind != TOKEN_WORD)
+    {
+      printOutput(shellOutput, "smallsh: history: -s needs a string\n");
+      return;
+    }
+    sizeHistory(history); // brings the index up to date for the search
+    for (n = searchHistory(history, token->text, token->length, 0); n > 0;
+         n = searchHistory(history, token->text, token->length, n))
+    {
+      line = getHistory(history, n, &lineLength);
+      printOutput(shellOutput, "%5d  %.*s\n", n, (int)lineLength, line);
+    }
+    return;
+  }
+
+  // Sized once, as each call checks the file for new lines
+  size = sizeHistory(history);
+  count = size;
+  if (token->kind == TOKEN_WORD)
+  {
+    count = strtol(token->text, &end, 10);
+    if (*end != '\0' || count < 0)
+    {
+      printOutput(shellOutput, "smallsh: history: invalid count %s\n",
+                  token->text);
+      return;
+    }
+  }
+
+  n = size - count + 1;
+  for (n = n > 1 ? n : 1; n <= size; n++)
+  {
+    line = getHistory(history, n, &lineLength);
+    printOutput(shellOutput, "%5d  %.*s\n", n, (int)lineLength, line);
+  }
+}
+
+/*********************************************************************
+ ** expandHistory
+ ** Description: Replaces the !word that starts a line with the line it
+ ** recalls: !! for the last line, !n for line n, !-n for the nth
+ ** line back and !text for the newest line starting with text. The
+ ** rest of the line is kept after it. The result is shown, as it is
+ ** what runs. Returns the new line in the command arena, or NULL
+ ** after printing an error
+ ** Parameters: char* input, size_t* length
+ *********************************************************************/
+char* expandHistory(char* input, size_t* length)
+{
+  const char* line = NULL;
+  char* designator = input + 1;
+  char* end;
+  char* expanded;
+  size_t designatorLength,
+         lineLength;
+  long n = 0;
+
+  // A lone ! is left alone
+  designatorLength = strcspn(designator, " \t");
+  if (designatorLength == 0)
+    return input;
+
+  if (designatorLength == 1 && designator[0] == '!')
+    n = sizeHistory(history);
+  else if (isdigit((unsigned char)designator[0]) || designator[0] == '-')
+  {
+    n = strtol(designator, &end, 10);
+    if (end != designator + designatorLength)
+      n = 0;
+    else if (n < 0)
+      n += sizeHistory(history) + 1;
+  }
+  else
+    n = findHistoryPrefix(history, designator, designatorLength);
+
+  if (n > 0 && n <= sizeHistory(history))
+    line = getHistory(history, (int)n, &lineLength);
+  if (line == NULL)
+  {
+    printOutput(shellOutput, "smallsh: !%.*s: event not found\n",
+                (int)designatorLength, designator);
+    return NULL;
+  }
+
+  // The recalled line, then whatever followed the !word
+  end = designator + designatorLength;
+  *length = lineLength + strlen(end);
+  expanded = allocArena(commandArena, *length + 1);
+  memcpy(expanded, line, lineLength);
+  strcpy(expanded + lineLength, end);
+  printOutput(shellOutput, "%s\n", expanded);
+  return expanded;
+}
+
+/*********************************************************************
+ ** openHistoryFile
+ ** Description: Opens the history file, $HISTFILE or else
+ ** .smallsh_history in the home directory. Without one the shell
+ ** runs without history
+ ** Parameters: none
+ *********************************************************************/
+void openHistoryFile()
+{
+  char path[PATH_MAX];
+
+  if (getenv("HISTFILE") != NULL)
+    snprintf(path, sizeof(path), "%s", getenv("HISTFILE"));
+  else if (getenv("HOME") != NULL)
+    snprintf(path, sizeof(path), "%s/.smallsh_history", getenv("HOME"));
+  else
+    return;
+  history = openHistory(path);
+}
+
+/*********************************************************************
+ ** statsCommand
+ ** Description: Prints the hot-path stats, and the audit log's count
+ ** of dropped records if it is open. on and off start and stop
+ ** timing, reset zeroes the counts, and dump file [seconds] rewrites
+ ** file with them every few seconds (dump off stops that)
+ ** Parameters: struct token* token
+ *********************************************************************/
+void statsCommand(struct token* token)
+{
+  char* end;
+  double seconds = STATS_DUMP_SECONDS;
+
+  token++;
+  if (token->kind != TOKEN_WORD)
+  {
+    if (!statsFlag)
+      printOutput(shellOutput, "stats are off; stats on starts them\n");
+    printStats(shellOutput);
+    if (auditLog != NULL)
+      printOutput(shellOutput, "%-10s %10ld\n", "audit_drop",
+                  droppedAuditRecords(auditLog));
+  }
+  else if (strcmp(token->text, "on") == 0)
+  {
+    if (enableStats() == -1)
+      printOutput(shellOutput, "smallsh: stats: cannot allocate\n");
+  }
+  else if (strcmp(token->text, "off") == 0)
+    disableStats();
+  else if (strcmp(token->text, "reset") == 0)
+    resetStats();
+  else if (strcmp(token->text, "dump") == 0)
+  {
+    token++;
+    if (token->kind != TOKEN_WORD)
+    {
+      printOutput(shellOutput, "smallsh: stats: dump needs a file\n");
+      return;
+    }
+    if (strcmp(token->text, "off") == 0)
+    {
+      setStatsDump(NULL, 0);
+      return;
+    }
+    if (token[1].kind == TOKEN_WORD)
+    {
+      seconds = strtod(token[1].text, &end);
+      if (*end != '\0' || !(seconds > 0))
+      {
+        printOutput(shellOutput, "smallsh: stats: invalid interval %s\n",
+                    token[1].text);
+        return;
+      }
+    }
+    setStatsDump(token->text, seconds);
+  }
+  else
+    printOutput(shellOutput, "smallsh: stats: unknown option %s\n",
+                token->text);
+}
+
+/*********************************************************************
+ ** initStats
+ ** Description: Starts timing if $SMALLSH_STATS is set, and dumping to
+ ** $SMALLSH_STATS_FILE every $SMALLSH_STATS_INTERVAL seconds (10 if
+ ** unset) if that is set
+ ** Parameters: none
+ *********************************************************************/
+void initStats()
+{
+  const char* value;
+  char* end;
+  double seconds = STATS_DUMP_SECONDS;
+
+  value = getenv("SMALLSH_STATS");
+  if (value != NULL && value[0] != '\0')
+    enableStats();
+
+  value = getenv("SMALLSH_STATS_INTERVAL");
+  if (value != NULL)
+  {
+    seconds = strtod(value, &end);
+    if (*end != '\0' || !(seconds > 0))
+      seconds = STATS_DUMP_SECONDS;
+  }
+  value = getenv("SMALLSH_STATS_FILE");
+  if (value != NULL && value[0] != '\0')
+    setStatsDump(value, seconds);
+}
+
+/*********************************************************************
+ ** setStatsDump
+ ** Description: Starts dumping the stats to path every few seconds,
+ ** turning timing on, or stops when path is NULL. The event loop's
+ ** timer wakes an idle prompt for each dump
+ ** Parameters: const char* path, double seconds
+ *********************************************************************/
+void setStatsDump(const char* path, double seconds)
+{
+  free(statsDumpPath);
+  statsDumpPath = NULL;
+  setEventTimer(eventLoop, 0);
+  if (path == NULL)
+    return;
+
+  if (enableStats() == -1)
+  {
+    printOutput(shellOutput, "smallsh: stats: cannot allocate\n");
+    return;
+  }
+  statsDumpPath = strdup(path);
+  statsDumpSeconds = seconds;
+  nextStatsDumpNs = nowStatNs() + (long)(seconds * 1e9);
+  setEventTimer(eventLoop, seconds);
+}
+
+/*********************************************************************
+ ** writeStatsDump
+ ** Description: Dumps the stats and schedules the next dump. A file
+ ** that cannot be written is reported and dumping stops
+ ** Parameters: none
+ *********************************************************************/
+void writeStatsDump()
+{
+  if (dumpStats(statsDumpPath) == -1)
+  {
+    printOutput(shellOutput, "smallsh: stats: cannot write %s\n",
+                statsDumpPath);
+    setStatsDump(NULL, 0);
+    return;
+  }
+  nextStatsDumpNs = nowStatNs() + (long)(statsDumpSeconds * 1e9);
+  setEventTimer(eventLoop, statsDumpSeconds);
+}
+
+/*********************************************************************
+ ** openAuditFile
+ ** Description: Starts the audit log if $SMALLSH_AUDIT names a file.
+ ** $SMALLSH_AUDIT_SIZE sets the size in bytes at which it is rotated
+ ** Parameters: none
+ *********************************************************************/
+void openAuditFile()
+{
+  const char* path = getenv("SMALLSH_AUDIT");
+  const char* size = getenv("SMALLSH_AUDIT_SIZE");
+  char* end;
+  long rotateBytes = AUDIT_ROTATE_BYTES;
+
+  if (path == NULL || path[0] == '\0')
+    return;
+  if (size != NULL)
+  {
+    rotateBytes = strtol(size, &end, 10);
+    if (*end != '\0' || rotateBytes <= 0)
+      rotateBytes = AUDIT_ROTATE_BYTES;
+  }
+  auditLog = openAuditLog(path, rotateBytes);
+  if (auditLog == NULL)
+    printOutput(shellOutput, "smallsh: unable to open audit log %s\n",
+                path);
+}
+
+/*********************************************************************
+ ** auditCommand
+ ** Description: Logs a command: each stage's arguments and
+ ** redirections, whether it ran in the background, the PID it is
+ ** tracked by (0 for a utility run in the shell), when it started and
+ ** ended, and its status. A background command is logged when it
+ ** starts, without an end or status, and again by auditJobEnd()
+ ** Parameters: const char* event, struct stage* stages, int stageCount,
+ ** pid_t pid, int backgroundFlag, struct timespec* start,
+ ** const char* statusMsg (NULL if not known yet)
+ *********************************************************************/
+void auditCommand(const char* event, struct stage* stages, int stageCount,
+                  pid_t pid, int backgroundFlag, struct timespec* start,
+                  const char* statusMsg)
+{
+  struct redirect* redirect;
+  struct timespec now;
+  char** arg;
+  int i,
+      j;
+
+  beginAuditRecord(auditLog);
+  addAuditString(auditLog, "event", event, strlen(event));
+  addAuditTime(auditLog, "start", start);
+  if (statusMsg != NULL)
+  {
+    clock_gettime(CLOCK_REALTIME, &now);
+    addAuditTime(auditLog, "end", &now);
+  }
+  if (pid != 0)
+    addAuditNumber(auditLog, "pid", pid);
+  addAuditFlag(auditLog, "background", backgroundFlag);
+
+  openAuditGroup(auditLog, "stages", '[');
+  for (i = 0; i < stageCount; i++)
+  {
+    openAuditGroup(auditLog, NULL, '{');
+    openAuditGroup(auditLog, "argv", '[');
+    for (arg = stages[i].arg; *arg != NULL; arg++)
+      addAuditString(auditLog, NULL, *arg, strlen(*arg));
+    closeAuditGroup(auditLog, ']');
+
+    openAuditGroup(auditLog, "redirects", '[');
+    for (j = 0; j < stages[i].redirectCount; j++)
+    {
+      redirect = &stages[i].redirects[j];
+      openAuditGroup(auditLog, NULL, '{');
+      addAuditNumber(auditLog, "fd", redirect->fd);
+      addAuditString(auditLog, "op", redirectOperator(redirect),
+                     strlen(redirectOperator(redirect)));
+      if (redirect->kind == REDIRECT_FILE)
+        addAuditString(auditLog, "target", redirect->text,
+                       strlen(redirect->text));
+      else if (redirect->kind == REDIRECT_DUP)
+        addAuditNumber(auditLog, "target", redirect->sourceFd);
+      else
+        addAuditNumber(auditLog, "bytes", redirect->length);
+      closeAuditGroup(auditLog, '}');
+    }
+    closeAuditGroup(auditLog, ']');
+    closeAuditGroup(auditLog, '}');
+  }
+  closeAuditGroup(auditLog, ']');
+
+  if (statusMsg != NULL)
+    addAuditString(auditLog, "status", statusMsg,
+                   strcspn(statusMsg, "\n"));
+  endAuditRecord(auditLog);
+}
+
+/*********************************************************************
+ ** auditJobEnd
+ ** Description: Logs the end of a job, in the background or after fg,
+ ** with its command line (less any here-document lines) and how long
+ ** it ran
+ ** Parameters: struct job* job, const char* statusMsg
+ *********************************************************************/
+void auditJobEnd(struct job* job, const char* statusMsg)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  beginAuditRecord(auditLog);
+  addAuditString(auditLog, "event", "end", 3);
+  addAuditTime(auditLog, "end", &now);
+  addAuditNumber(auditLog, "pid", job->pid);
+  addAuditString(auditLog, "line", job->commandLine,
+                 strcspn(job->commandLine, "\n"));
+  addAuditNumber(auditLog, "duration_us",
+                 (long)(secondsSince(&job->startTime) * 1e6));
+  addAuditString(auditLog, "status", statusMsg, strcspn(statusMsg, "\n"));
+  endAuditRecord(auditLog);
+}
+
+/*********************************************************************
+ ** redirectOperator
+ ** Description: Returns the operator a redirection was written with,
+ ** as far as it can be told from what it does
+ ** Parameters: struct redirect* redirect
+ *********************************************************************/
+const char* redirectOperator(struct redirect* redirect)
+{
+  if (redirect->kind == REDIRECT_TEXT)
+    return "<<";
+  if (redirect->kind == REDIRECT_DUP)
+    return redirect->fd == 0 ? "<&" : ">&";
+  if ((redirect->flags & O_ACCMODE) == O_RDONLY)
+    return "<";
+  if (redirect->flags & O_APPEND)
+    return ">>";
+  return ">";
+}
+
+/*********************************************************************
+ ** jobsCommand
+ ** Description: Lists the background and stopped jobs by job number
+ ** Parameters: JobTable* jobs
+ *********************************************************************/
+void jobsCommand(JobTable* jobs)
+{
+  struct job** sorted;
+  int i;
+
+  sorted = allocArena(commandArena, sizeof(struct job*) *
+                      (sizeJobTable(jobs) + 1));
+  for (i = 0; i < sizeJobTable(jobs); i++)
+    sorted[i] = getJobAt(jobs, i);
+  qsort(sorted, sizeJobTable(jobs), sizeof(struct job*), compareJobIds);
+  for (i = 0; i < sizeJobTable(jobs); i++)
+    printJob(sorted[i]);
+}
+
+/*********************************************************************
+ ** fgCommand
+ ** Description: Brings a job (the newest one if none is given) to the
+ ** foreground: gives it the terminal, continues it and waits for it
+ ** like any foreground command. If it stops again it stays a job
+ ** Parameters: struct token* token, JobTable* jobs, char* statusMsg
+ *********************************************************************/
+void fgCommand(struct token* token, JobTable* jobs, char* statusMsg)
+{
+  struct job* job;
+  int status = -1;
+
+  job = findJobArgument(token, jobs, "fg");
+  if (job == NULL)
+    return;
+
+  printOutput(shellOutput, "%.*s\n",
+              (int)strcspn(job->commandLine, "\n"), job->commandLine);
+  flushOutputWriter(shellOutput);
+  if (jobControlFlag && job->pgid != 0)
+    tcsetpgrp(0, job->pgid);
+  signalJob(job, SIGCONT);
+  job->state = JOB_RUNNING;
+
+  memset(&lastForegroundUsage, 0, sizeof(lastForegroundUsage));
+  if (waitForeground(&job->pid, 1, &status))
+  {
+    takeTerminal();
+    job->state = JOB_STOPPED;
+    printJob(job);
+    return;
+  }
+  takeTerminal();
+
+  if (status != -1)
+    setForegroundStatus(status, statusMsg);
+  lastForegroundUsage.wallSeconds = secondsSince(&job->startTime);
+  if (auditLog != NULL)
+    auditJobEnd(job, statusMsg);
+  if (job->timedFlag)
+    printUsage(&lastForegroundUsage);
+
+  // It ended in the foreground, so it is not reported as a background
+  // job
+  if (job->pidFd != -1)
+  {
+    unwatchEvent(eventLoop, job->pidFd);
+    close(job->pidFd);
+  }
+  removeJob(jobs, job->pid);
+}
+
+/*********************************************************************
+ ** bgCommand
+ ** Description: Continues a stopped job (the newest one if none is
+ ** given) in the background
+ ** Parameters: struct token* token, JobTable* jobs
+ *********************************************************************/
+void bgCommand(struct token* token, JobTable* jobs)
+{
+  struct job* job;
+
+  job = findJobArgument(token, jobs, "bg");
+  if (job == NULL)
+    return;
+  if (job->state != JOB_STOPPED)
+  {
+    printOutput(shellOutput, "smallsh: bg: job %d is already running\n",
+                job->jobId);
+    return;
+  }
+
+  signalJob(job, SIGCONT);
+  job->state = JOB_RUNNING;
+  printJob(job);
+}
+
+/*********************************************************************
+ ** findJobArgument
+ ** Description: Returns the job named after fg or bg, written as %n
+ ** or n, or the newest job if none is named. Prints an error and
+ ** returns NULL if there is no such job
+ ** Parameters: struct token* token, JobTable* jobs, const char* name
+ *********************************************************************/
+struct job* findJobArgument(struct token* token, JobTable* jobs,
+                            const char* name)
+{
+  struct job* job;
+  char* text;
+  char* end;
+  long jobId = 0;
+
+  token++;
+  if (token->kind == TOKEN_WORD && strcmp(token->text, "%%") != 0 &&
+      strcmp(token->text, "%+") != 0)
+  {
+    text = token->text[0] == '%' ? token->text + 1 : token->text;
+    jobId = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || jobId <= 0 || jobId > INT_MAX)
+    {
+      printOutput(shellOutput, "smallsh: %s: invalid job %s\n", name,
+                  token->text);
+      return NULL;
+    }
+  }
+
+  job = findJobById(jobs, (int)jobId);
+  if (job == NULL)
+    printOutput(shellOutput, "smallsh: %s: no such job\n", name);
+  return job;
+}
+
+/*********************************************************************
+ ** compareJobIds
+ ** Description: qsort() comparison of two job pointers by job number
+ ** Parameters: const void* a, const void* b
+ *********************************************************************/
+int compareJobIds(const void* a, const void* b)
+{
+  return (*(struct job* const*)a)->jobId - (*(struct job* const*)b)->jobId;
+}
+
+/*********************************************************************
+ ** printJob
+ ** Description: Prints a job's number, PID, state and command line.
+ ** Here-document lines kept with the command are left out
+ ** Parameters: struct job* job
+ *********************************************************************/
+void printJob(struct job* job)
+{
+  // Finish the line the prompt was left on
+  if (promptShownFlag)
+  {
+    putOutput(shellOutput, "\n");
+    promptShownFlag = 0;
+  }
+  printOutput(shellOutput, "[%d] %d %s  %.*s\n", job->jobId, job->pid,
+              job->state == JOB_STOPPED ? "stopped" : "running",
+              (int)strcspn(job->commandLine, "\n"), job->commandLine);
+}
+
+/*********************************************************************
+ ** signalJob
+ ** Description: Sends a signal to every process of a job through its
+ ** process group, or to its one tracked process (by pidfd when it has
+ ** one) if it has no group
+ ** Parameters: struct job* job, int signo
+ *********************************************************************/
+void signalJob(struct job* job, int signo)
+{
+  if (job->pgid != 0 && killpg(job->pgid, signo) == 0)
+    return;
+  if (job->pidFd == -1 ||
+      pidfd_send_signal(job->pidFd, signo, NULL, 0) == -1)
+    kill(job->pid, signo);
+}
+
+/*********************************************************************
+ ** startQueuedJobs
+ ** Description: Starts queued background commands, oldest first,
+ ** while there are free job slots. A queued line is tokenized again,
+ ** so its variables are expanded when it starts
+ ** Parameters: JobTable* jobs, char* statusMsg
+ *********************************************************************/
+void startQueuedJobs(JobTable* jobs, char* statusMsg)
+{
+  char* commandLine;
+  char* lines;
+  struct token* token;
+  struct prefixes prefixes;
+
+  while (sizeJobQueue(jobQueue) > 0 &&
+         (jobLimit == 0 || sizeJobTable(jobs) < jobLimit))
+  {
+    commandLine = dequeueJob(jobQueue);
+
+    // Any here-document lines were queued after the command itself
+    lines = strchr(commandLine, '\n');
+    if (lexLine(commandArena, commandLine, lines != NULL ?
+                (size_t)(lines - commandLine) : strlen(commandLine), vars,
+                &token) == -1)
+    {
+      printOutput(shellOutput, "smallsh: unterminated quote\n");
+      free(commandLine);
+      continue;
+    }
+    if (lines != NULL)
+      readHereDocs(token, commandLine,
+                   copyArena(commandArena, lines + 1, strlen(lines + 1)));
+
+    token = parsePrefixes(token, &prefixes);
+    if (token != NULL)
+      otherCommand(token, commandLine, jobs, statusMsg, &prefixes);
+    free(commandLine);
+  }
+}
+
+/*********************************************************************
+ ** readHereDocs
+ ** Description: Reads the body of each << here-document on a command
+ ** line, up to the line holding only its delimiter, and puts it in
+ ** place of the delimiter word. Lines come from the input, or from
+ ** lines when a queued command is started. Returns the command line
+ ** with the here-document lines appended, so the jobs table and the
+ ** queue keep them
+ ** Parameters: struct token* token, char* commandLine, char* lines
+ ** (rest of a queued command, NULL to read from the input)
+ *********************************************************************/
+char* readHereDocs(struct token* token, char* commandLine, char* lines)
+{
+  char* line;
+  char* body;
+  char* fullLine = commandLine;
+  size_t bodyLength,
+         bodyCapacity,
+         fullLength = 0,
+         fullCapacity = 0,
+         length;
+
+  for (; token->kind != TOKEN_END; token++)
+  {
+    if (token->kind != TOKEN_HEREDOC || token[1].kind != TOKEN_WORD)
+      continue;
+
+    // The input buffer is reused by the next read, so keep the
+    // command line in the arena before reading the body
+    if (lines == NULL && fullCapacity == 0)
+    {
+      fullLength = strlen(commandLine);
+      fullCapacity = fullLength + 256;
+      fullLine = allocArena(commandArena, fullCapacity);
+      memcpy(fullLine, commandLine, fullLength + 1);
+    }
+
+    bodyLength = 0;
+    bodyCapacity = 256;
+    body = allocArena(commandArena, bodyCapacity);
+    while (1)
+    {
+      if (lines != NULL)
+        line = nextHereDocLine(&lines);
+      else
+      {
+        if (interactiveFlag)
+        {
+          putOutput(shellOutput, "> ");
+          flushOutputWriter(shellOutput);
+        }
+        line = readLine(inputReader, NULL);
+      }
+      if (line == NULL) // end of input also ends the here-document
+        break;
+      length = strlen(line);
+
+      // Remember the line as typed, with its newline
+      if (lines == NULL)
+      {
+        if (fullLength + length + 2 > fullCapacity)
+        {
+          fullLine = growArena(commandArena, fullLine, fullCapacity,
+                               2 * (fullLength + length + 2));
+          fullCapacity = 2 * (fullLength + length + 2);
+        }
+        fullLine[fullLength++] = '\n';
+        memcpy(fullLine + fullLength, line, length + 1);
+        fullLength += length;
+      }
+
+      if (strcmp(line, token[1].text) == 0)
+        break;
+
+      if (bodyLength + length + 1 > bodyCapacity)
+      {
+        body = growArena(commandArena, body, bodyCapacity,
+                         2 * (bodyLength + length + 1));
+        bodyCapacity = 2 * (bodyLength + length + 1);
+      }
+      memcpy(body + bodyLength, line, length);
+      bodyLength += length;
+      body[bodyLength++] = '\n';
+    }
+
+    token[1].text = body;
+    token[1].length = bodyLength;
+    token++;
+  }
+  return fullLine;
+}
+
+/*********************************************************************
+ ** nextHereDocLine
+ ** Description: Cuts the next line from a queued command's
+ ** here-document lines, or returns NULL when there are none left
+ ** Parameters: char** lines (advanced past the line)
+ *********************************************************************/
+char* nextHereDocLine(char** lines)
+{
+  char* line = *lines;
+  char* newline;
+
+  if (*line == '\0')
+    return NULL;
+  newline = strchr(line, '\n');
+  if (newline != NULL)
+  {
+    *newline = '\0';
+    *lines = newline + 1;
+  }
+  else
+    *lines = line + strlen(line);
+  return line;
+}
+
+/*********************************************************************
+ ** openHereDoc
+ ** Description: Writes here-document text to an anonymous in-memory
+ ** file and returns a descriptor for it, positioned at the start, or
+ ** -1 on failure. Nothing touches the filesystem, so there is no
+ ** temporary file to remove
+ ** Parameters: const char* text, size_t length
+ *********************************************************************/
+int openHereDoc(const char* text, size_t length)
+{
+  int fileDescriptor;
+  ssize_t bytesWritten;
+  size_t offset = 0;
+
+  fileDescriptor = memfd_create("smallsh-heredoc", MFD_CLOEXEC);
+  if (fileDescriptor == -1)
+    return -1;
+
+  while (offset < length)
+  {
+    bytesWritten = write(fileDescriptor, text + offset, length - offset);
+    if (bytesWritten == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      close(fileDescriptor);
+      return -1;
+    }
+    offset += bytesWritten;
+  }
+  lseek(fileDescriptor, 0, SEEK_SET);
+  return fileDescriptor;
+}
+
+/*********************************************************************
+ ** parseRedirect
+ ** Description: Fills in the redirection for an operator and the word
+ ** after it. Returns the number of entries used (&> and &>> use two),
+ ** or -1 if the word is not a valid descriptor
+ ** Parameters: struct token* token, struct redirect* redirect (room
+ ** for two entries)
+ *********************************************************************/
+int parseRedirect(struct token* token, struct redirect* redirect)
+{
+  struct token* word = token + 1;
+  char* end;
+  long sourceFd;
+
+  redirect->kind = REDIRECT_FILE;
+  redirect->fd = token->fd;
+  redirect->sourceFd = -1;
+  redirect->text = word->text;
+  redirect->length = word->length;
+
+  switch (token->kind)
+  {
+    case TOKEN_IN:
+      redirect->flags = O_RDONLY;
+      return 1;
+    case TOKEN_OUT:
+      redirect->flags = O_WRONLY|O_CREAT|O_TRUNC;
+      return 1;
+    case TOKEN_APPEND:
+      redirect->flags = O_WRONLY|O_CREAT|O_APPEND;
+      return 1;
+
+    case TOKEN_OUT_ALL: // the file, then stderr copied from stdout
+    case TOKEN_APPEND_ALL:
+      redirect->flags = O_WRONLY|O_CREAT|(token->kind == TOKEN_OUT_ALL ?
+                                          O_TRUNC : O_APPEND);
+      redirect[1].kind = REDIRECT_DUP;
+      redirect[1].fd = 2;
+      redirect[1].sourceFd = 1;
+      return 2;
+
+    case TOKEN_DUP: // a descriptor number, or - to close
+      redirect->kind = REDIRECT_DUP;
+      if (strcmp(word->text, "-") == 0)
+        return 1;
+      sourceFd = strtol(word->text, &end, 10);
+      if (word->length == 0 || *end != '\0' || sourceFd < 0 ||
+          sourceFd > INT_MAX)
+      {
+        printOutput(shellOutput, "smallsh: %s: bad file descriptor\n",
+                    word->text);
+        return -1;
+      }
+      redirect->sourceFd = (int)sourceFd;
+      return 1;
+
+    case TOKEN_HEREDOC: // body was read by readHereDocs()
+      redirect->kind = REDIRECT_TEXT;
+      return 1;
+    case TOKEN_HERESTRING: // the word plus a newline
+      redirect->kind = REDIRECT_TEXT;
+      redirect->text = allocArena(commandArena, word->length + 1);
+      memcpy(redirect->text, word->text, word->length);
+      redirect->text[word->length] = '\n';
+      redirect->length = word->length + 1;
+      return 1;
+  }
+  return -1;
+}
+
+/*********************************************************************
+ ** openStageHereDocs
+ ** Description: Puts each here-document of a stage in an in-memory
+ ** file the child duplicates like any other descriptor. One that
+ ** cannot be created reads from dev/null instead
+ ** Parameters: struct stage* stage
+ *********************************************************************/
+void openStageHereDocs(struct stage* stage)
+{
+  struct redirect* redirect;
+  int i;
+
+  for (i = 0; i < stage->redirectCount; i++)
+  {
+    redirect = &stage->redirects[i];
+    if (redirect->kind != REDIRECT_TEXT)
+      continue;
+    redirect->sourceFd = openHereDoc(redirect->text, redirect->length);
+    if (redirect->sourceFd == -1)
+    {
+      printOutput(shellOutput, "smallsh: unable to create here-document\n");
+      redirect->sourceFd = devNullFd;
+    }
+  }
+}
+
+/*********************************************************************
+ ** closeStageHereDocs
+ ** Description: Closes the shell's copies of a launched stage's
+ ** here-document files
+ ** Parameters: struct stage* stage
+ *********************************************************************/
+void closeStageHereDocs(struct stage* stage)
+{
+  int i;
+
+  for (i = 0; i < stage->redirectCount; i++)
+    if (stage->redirects[i].kind == REDIRECT_TEXT &&
+        stage->redirects[i].sourceFd != devNullFd)
+    {
+      close(stage->redirects[i].sourceFd);
+      stage->redirects[i].sourceFd = -1;
+    }
+}
+
+/*********************************************************************
+ ** waitForeground
+ ** Description: Waits for the processes of a foreground command in
+ ** turn, adding up what they used. Returns true (1) as soon as one is
+ ** stopped instead; the rest are then left to the background sweep
+ ** Parameters: pid_t* pids, int count, int* status (set to the last
+ ** process's wait status)
+ *********************************************************************/
+int waitForeground(pid_t* pids, int count, int* status)
+{
+  struct rusage usage;
+  int childStatus,
+      i;
+  long startNs = startStat();
+
+  for (i = 0; i < count; i++)
+  {
+    if (wait4(pids[i], &childStatus, WUNTRACED, &usage) == -1)
+      continue;
+    if (WIFSTOPPED(childStatus))
+    {
+      endStat(STAT_WAIT, startNs);
+      return 1;
+    }
+    addUsage(&lastForegroundUsage, &usage);
+    if (i == count - 1)
+      *status = childStatus;
+  }
+  endStat(STAT_WAIT, startNs);
+  return 0;
+}
+
+/*********************************************************************
+ ** initJobControl
+ ** Description: Sets up job control for an interactive shell: waits
+ ** to be in the foreground, ignores the terminal stop signals, leads
+ ** its own process group and takes the terminal. Job control stays
+ ** off if the terminal cannot be taken
+ ** Parameters: none
+ *********************************************************************/
+void initJobControl()
+{
+  // Started in the background: stop until brought to the foreground
+  while ((terminalPgid = tcgetpgrp(0)) != getpgrp())
+  {
+    if (terminalPgid == -1)
+      return;
+    kill(0, SIGTTIN);
+  }
+
+  action.sa_handler = SIG_IGN;
+  sigaction(SIGTSTP, &action, NULL);
+  sigaction(SIGTTIN, &action, NULL);
+  sigaction(SIGTTOU, &action, NULL);
+
+  setpgid(0, 0); // fails harmlessly if already a group or session leader
+  shellPgid = getpgrp();
+  if (tcsetpgrp(0, shellPgid) == -1)
+    return;
+  tcgetattr(0, &shellModes);
+  jobControlFlag = 1;
+}
+
+/*********************************************************************
+ ** takeTerminal
+ ** Description: Takes the terminal back from a foreground job and
+ ** restores the shell's terminal settings, which the job may have
+ ** changed
+ ** Parameters: none
+ *********************************************************************/
+void takeTerminal()
+{
+  if (!jobControlFlag)
+    return;
+  tcsetpgrp(0, shellPgid);
+  tcsetattr(0, TCSADRAIN, &shellModes);
+}
+
+/*********************************************************************
+ ** getExitStatus 
+ ** Description: Gets the exit value or termination signal of a 
+ ** process and updates the current foreground status message
+ ** Parameters: int status, char* statusMsg
+ *********************************************************************/
+void getExitStatus(int status, char* statusMsg)
+{
+  if (WIFEXITED(status))
+    sprintf(statusMsg, "exit status %d\n", WEXITSTATUS(status));
+  else if (WIFSIGNALED(status))
+    sprintf(statusMsg, "terminated by signal %d\n", WTERMSIG(status));
+  else
+    sprintf(statusMsg, "unknown status\n");
+}
+
+/*********************************************************************
+ ** setForegroundStatus
+ ** Description: Updates the foreground status message, and $? to the
+ ** exit value (128 plus the signal number if it was killed)
+ ** Parameters: int status, char* statusMsg
+ *********************************************************************/
+void setForegroundStatus(int status, char* statusMsg)
+{
+  getExitStatus(status, statusMsg);
+  if (WIFEXITED(status))
+    setStatusVarTable(vars, WEXITSTATUS(status));
+  else if (WIFSIGNALED(status))
+    setStatusVarTable(vars, 128 + WTERMSIG(status));
+}
+
+/*********************************************************************
+ ** addUsage
+ ** Description: Adds a process's resource usage from wait4() to a
+ ** job's totals. The largest RSS is kept rather than summed
+ ** Parameters: struct jobUsage* total, struct rusage* usage
+ *********************************************************************/
+void addUsage(struct jobUsage* total, struct rusage* usage)
+{
+  total->userSeconds += usage->ru_utime.tv_sec +
+                        usage->ru_utime.tv_usec / 1e6;
+  total->systemSeconds += usage->ru_stime.tv_sec +
+                          usage->ru_stime.tv_usec / 1e6;
+  if (usage->ru_maxrss > total->maxRSS)
+    total->maxRSS = usage->ru_maxrss;
+  total->minorFaults += usage->ru_minflt;
+  total->majorFaults += usage->ru_majflt;
+}
+
+/*********************************************************************
+ ** printUsage
+ ** Description: Prints a job's resource usage on one line
+ ** Parameters: struct jobUsage* usage
+ *********************************************************************/
+void printUsage(struct jobUsage* usage)
+{
+  printOutput(shellOutput, "real %.3fs user %.3fs sys %.3fs maxrss %ldKB "
+              "faults %ld minor, %ld major\n", usage->wallSeconds,
+              usage->userSeconds, usage->systemSeconds, usage->maxRSS,
+              usage->minorFaults, usage->majorFaults);
+}
+
+/*********************************************************************
+ ** secondsSince
+ ** Description: Returns the seconds elapsed since a CLOCK_MONOTONIC
+ ** time
+ ** Parameters: struct timespec* start
+ *********************************************************************/
+double secondsSince(struct timespec* start)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) +
+         (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*********************************************************************
+ ** performRedirect
+ ** Description: In a forked child, applies one redirection, or ends
+ ** the child with a message if it cannot be applied
+ ** Parameters: struct redirect* redirect
+ *********************************************************************/
+void performRedirect(struct redirect* redirect)
+{
+  char errorMsg[PATH_MAX + 64];
+  int exitValue;
+
+  exitValue = applyRedirect(redirect, errorMsg, sizeof(errorMsg));
+  if (exitValue != 0)
+  {
+    printf("%s", errorMsg);
+    fflush(stdout);
+    exit(exitValue);
+  }
+}
+
+/*********************************************************************
+ ** applyRedirect
+ ** Description: Applies one redirection to the calling process. A file
+ ** is opened close-on-exec and its temporary descriptor closed once
+ ** it has been moved into place, so nothing extra reaches the
+ ** command. Returns 0, or the exit value for the failure with its
+ ** message in errorMsg
+ ** Parameters: struct redirect* redirect, char* errorMsg, size_t size
+ *********************************************************************/
+int applyRedirect(struct redirect* redirect, char* errorMsg, size_t size)
+{
+  int fileDescriptor;
+
+  if (redirect->kind == REDIRECT_FILE)
+  {
+    fileDescriptor = open(redirect->text, redirect->flags|O_CLOEXEC, 0644);
+    if (fileDescriptor == -1)
+    {
+      snprintf(errorMsg, size, "smallsh: unable to open %s for %s\n",
+               redirect->text,
+               redirect->flags == O_RDONLY ? "input" : "output");
+      return 1;
+    }
+
+    if (fileDescriptor == redirect->fd)
+      fcntl(fileDescriptor, F_SETFD, 0); // keep it across exec
+    else
+    {
+      if (dup2(fileDescriptor, redirect->fd) == -1)
+      {
+        close(fileDescriptor);
+        snprintf(errorMsg, size, "smallsh: dup2 failed\n");
+        return 2;
+      }
+      close(fileDescriptor);
+    }
+  }
+  else if (redirect->sourceFd == -1)
+    close(redirect->fd);
+  else if (redirect->sourceFd != redirect->fd &&
+           dup2(redirect->sourceFd, redirect->fd) == -1)
+  {
+    snprintf(errorMsg, size, "smallsh: %d: bad file descriptor\n",
+             redirect->sourceFd);
+    return 1;
+  }
+  return 0;
+}
+
+/*********************************************************************
+ ** runsInShell
+ ** Description: Returns true (1) unless the stage redirects or copies
+ ** a descriptor at or above SAVED_FD_BASE, where the shell keeps its
+ ** own descriptors while a utility runs, or one above 2 that is open.
+ ** Those belong to the shell too (script input, dev/null, the
+ ** self-pipe, the event loop, pidfds, history and audit log), so
+ ** such a command runs in a child instead
+ ** Parameters: struct stage* stage
+ *********************************************************************/
+int runsInShell(struct stage* stage)
+{
+  struct redirect* redirect;
+  int i;
+
+  for (i = 0; i < stage->redirectCount; i++)
+  {
+    redirect = &stage->redirects[i];
+    if (redirect->fd >= SAVED_FD_BASE ||
+        (redirect->fd > 2 && fcntl(redirect->fd, F_GETFD) != -1))
+      return 0;
+    if (redirect->kind == REDIRECT_DUP &&
+        (redirect->sourceFd >= SAVED_FD_BASE ||
+         (redirect->sourceFd > 2 &&
+          fcntl(redirect->sourceFd, F_GETFD) != -1)))
+      return 0;
+  }
+  return 1;
+}
+
+/*********************************************************************
+ ** utilityCommand
+ ** Description: Runs a utility inside the shell. Each descriptor the
+ ** stage redirects is first copied above SAVED_FD_BASE, then the
+ ** redirections are applied in order exactly as in a child, and the
+ ** copies are moved back once the utility is done. A redirection
+ ** that fails skips the utility with the same message and status a
+ ** child would give
+ ** Parameters: struct stage* stage, int builtin, char* statusMsg,
+ ** struct prefixes* prefixes
+ *********************************************************************/
+void utilityCommand(struct stage* stage, int builtin, char* statusMsg,
+                    struct prefixes* prefixes)
+{
+  struct savedFd
+  {
+    int fd;          // descriptor redirected
+    int savedFd;     // copy of what it was, -1 if it was closed
+    int cloexecFlag; // set if it was close-on-exec
+  };
+  struct savedFd* saved;
+  struct rusage before,
+                after;
+  struct timespec startTime;
+  char errorMsg[PATH_MAX + 64];
+  int savedCount = 0,
+      exitValue = 0,
+      status,
+      i,
+      j;
+
+  // Shell messages go out before the descriptors move
+  flushBeforeLaunch();
+  clock_gettime(CLOCK_MONOTONIC, &startTime);
+  getrusage(RUSAGE_SELF, &before);
+
+  openStageHereDocs(stage);
+  saved = allocArena(commandArena,
+                     sizeof(struct savedFd) * (stage->redirectCount + 1));
+  for (i = 0; i < stage->redirectCount && exitValue == 0; i++)
+  {
+    for (j = 0; j < savedCount && saved[j].fd != stage->redirects[i].fd; j++)
+      ;
+    if (j == savedCount)
+    {
+      saved[savedCount].fd = stage->redirects[i].fd;
+      saved[savedCount].cloexecFlag =
+        (fcntl(stage->redirects[i].fd, F_GETFD) & FD_CLOEXEC) != 0;
+      saved[savedCount].savedFd = fcntl(stage->redirects[i].fd,
+                                        F_DUPFD_CLOEXEC, SAVED_FD_BASE);
+      savedCount++;
+    }
+    exitValue = applyRedirect(&stage->redirects[i], errorMsg,
+                              sizeof(errorMsg));
+  }
+
+  if (exitValue == 0)
+    status = runUtility(builtin, stage->arg);
+  else
+    status = W_EXITCODE(exitValue, 0);
+
+  // Put the shell's descriptors back, the first saved last, with the
+  // close-on-exec flag each had
+  for (i = savedCount - 1; i >= 0; i--)
+  {
+    if (saved[i].savedFd == -1)
+      close(saved[i].fd);
+    else
+    {
+      dup3(saved[i].savedFd, saved[i].fd,
+           saved[i].cloexecFlag ? O_CLOEXEC : 0);
+      close(saved[i].savedFd);
+    }
+  }
+  closeStageHereDocs(stage);
+
+  if (exitValue != 0)
+    printOutput(shellOutput, "%s", errorMsg);
+  setForegroundStatus(status, statusMsg);
+
+  // What the utility used is what the shell used meanwhile
+  getrusage(RUSAGE_SELF, &after);
+  after.ru_utime.tv_sec -= before.ru_utime.tv_sec;
+  after.ru_utime.tv_usec -= before.ru_utime.tv_usec;
+  after.ru_stime.tv_sec -= before.ru_stime.tv_sec;
+  after.ru_stime.tv_usec -= before.ru_stime.tv_usec;
+  after.ru_minflt -= before.ru_minflt;
+  after.ru_majflt -= before.ru_majflt;
+  memset(&lastForegroundUsage, 0, sizeof(lastForegroundUsage));
+  addUsage(&lastForegroundUsage, &after);
+  lastForegroundUsage.wallSeconds = secondsSince(&startTime);
+  if (prefixes->timeFlag)
+    printUsage(&lastForegroundUsage);
+}
+
+/*********************************************************************
+ ** checkBackgroundJobs
+ ** Description: Reaps every child that has exited since the last call
+ ** and reports the ones that are background jobs. This catches
+ ** pipeline stages that are not tracked as jobs, and jobs whose pidfd
+ ** could not be opened. Jobs that were stopped or continued by a
+ ** signal are reported too, since pidfds only show exits
+ ** Parameters: JobTable* jobs, char* statusMsg
+ *********************************************************************/
+void checkBackgroundJobs(JobTable* jobs, char* statusMsg)
+{
+  pid_t endPID;
+  int status,
+      state;
+  char drain[64];
+  struct rusage usage;
+  struct job* doneJob;
+  long startNs = startStat();
+
+  // Clear the wakeup before reaping so a later exit sets it again
+  childExitFlag = 0;
+  while (read(childPipe[0], drain, sizeof(drain)) > 0)
+    ;
+
+  // Reap each finished child and look it up in the jobs table
+  while ((endPID = wait4(-1, &status, WNOHANG|WUNTRACED|WCONTINUED,
+                         &usage)) > 0)
+  {
+    doneJob = findJob(jobs, endPID);
+    if (doneJob == NULL)
+      continue;
+    if (WIFSTOPPED(status) || WIFCONTINUED(status))
+    {
+      // fg and bg set the state themselves, so only news is printed
+      state = WIFSTOPPED(status) ? JOB_STOPPED : JOB_RUNNING;
+      if (doneJob->state != state)
+      {
+        doneJob->state = state;
+        printJob(doneJob);
+      }
+    }
+    else
+      reportJob(jobs, doneJob, status, &usage, statusMsg);
+  }
+  endStat(STAT_SWEEP, startNs);
+}
+
+/*********************************************************************
+ ** handleEvents
+ ** Description: Waits up to timeoutMs for events (0 to only take what
+ ** is ready) and handles them: a job whose pidfd is ready is reaped
+ ** and reported at once, and the SIGCHLD pipe triggers a sweep for
+ ** everything else. Freed job slots then go to queued commands.
+ ** Returns true (1) if command input is ready
+ ** Parameters: JobTable* jobs, char* statusMsg, int timeoutMs
+ *********************************************************************/
+int handleEvents(JobTable* jobs, char* statusMsg, int timeoutMs)
+{
+  struct event events[EVENT_BATCH_SIZE];
+  int eventCount,
+      inputFlag = 0,
+      sweepFlag = 0,
+      i;
+
+  eventCount = waitEvents(eventLoop, events, EVENT_BATCH_SIZE, timeoutMs);
+  for (i = 0; i < eventCount; i++)
+  {
+    switch (events[i].kind)
+    {
+      case EVENT_JOB:
+        reapJob(jobs, events[i].id, statusMsg);
+        break;
+      case EVENT_CHILD:
+        sweepFlag = 1;
+        break;
+      case EVENT_INPUT:
+        inputFlag = 1;
+        break;
+      case EVENT_TIMER:
+        if (statsDumpPath != NULL)
+          writeStatsDump();
+        break;
+    }
+  }
+
+  // Job events go first, so the sweep only finds what they missed
+  if (sweepFlag || childExitFlag)
+    checkBackgroundJobs(jobs, statusMsg);
+
+  // Freed slots go to queued background commands
+  if (sizeJobQueue(jobQueue) > 0)
+    startQueuedJobs(jobs, statusMsg);
+  return inputFlag;
+}
+
+/*********************************************************************
+ ** watchJob
+ ** Description: Opens a pidfd for a new background job and adds it to
+ ** the event loop, so its exit is seen directly. The pidfd always
+ ** refers to this process, even if its PID is later reused. Without
+ ** one (old kernel, out of descriptors) the SIGCHLD sweep reaps it
+ ** Parameters: struct job* job
+ *********************************************************************/
+void watchJob(struct job* job)
+{
+  job->pidFd = pidfd_open(job->pid, 0);
+  if (job->pidFd != -1 &&
+      watchEvent(eventLoop, job->pidFd, EVENT_JOB, job->pid) == -1)
+  {
+    close(job->pidFd);
+    job->pidFd = -1;
+  }
+}
+
+/*********************************************************************
+ ** reapJob
+ ** Description: Reaps a job whose pidfd reported its exit
+ ** Parameters: JobTable* jobs, pid_t pid, char* statusMsg
+ *********************************************************************/
+void reapJob(JobTable* jobs, pid_t pid, char* statusMsg)
+{
+  int status;
+  struct rusage usage;
+  struct job* doneJob;
+
+  doneJob = findJob(jobs, pid);
+  if (doneJob != NULL && wait4(pid, &status, WNOHANG, &usage) > 0)
+    reportJob(jobs, doneJob, status, &usage, statusMsg);
+}
+
+/*********************************************************************
+ ** reportJob
+ ** Description: Prints that a background job is done with its exit
+ ** status or termination signal, records what it used and removes
+ ** it from the jobs table
+ ** Parameters: JobTable* jobs, struct job* doneJob, int status,
+ ** struct rusage* usage, char* statusMsg
+ *********************************************************************/
+void reportJob(JobTable* jobs, struct job* doneJob, int status,
+               struct rusage* usage, char* statusMsg)
+{
+  char lastForegroundMsg[256];
+
+  // Record what the job used
+  memset(&lastBackgroundUsage, 0, sizeof(lastBackgroundUsage));
+  addUsage(&lastBackgroundUsage, usage);
+  lastBackgroundUsage.wallSeconds = secondsSince(&doneJob->startTime);
+  lastBackgroundPID = doneJob->pid;
+
+  // Finish the line the prompt was left on
+  if (promptShownFlag)
+  {
+    putOutput(shellOutput, "\n");
+    promptShownFlag = 0;
+  }
+
+  // Print exit status and restore last foreground exit message
+  strcpy(lastForegroundMsg, statusMsg);
+  getExitStatus(status, statusMsg);
+  printOutput(shellOutput, "background pid %d is done: %s", doneJob->pid,
+              statusMsg);
+  if (auditLog != NULL)
+    auditJobEnd(doneJob, statusMsg);
+  strcpy(statusMsg, lastForegroundMsg);
+  if (doneJob->timedFlag)
+    printUsage(&lastBackgroundUsage);
+
+  // A forked cat child may share the pidfd, so leave the loop first
+  if (doneJob->pidFd != -1)
+  {
+    unwatchEvent(eventLoop, doneJob->pidFd);
+    close(doneJob->pidFd);
+  }
+  removeJob(jobs, doneJob->pid); // remove job from table
+  jobsCompleted++;
+}
+
+/*********************************************************************
+ ** flushBeforeLaunch
+ ** Description: Writes out the gathered messages before a child is
+ ** started, so the shell's messages and the child's output appear in
+ ** order. Nothing is left pending for a forked child to write again
+ ** Parameters: none
+ *********************************************************************/
+void flushBeforeLaunch()
+{
+  if (pendingOutput(shellOutput) > 0)
+    flushOutputWriter(shellOutput);
+}
+
+/*********************************************************************
+ ** catchSIGCHLD
+ ** Description: Signal handler for SIGCHLD. Records that a child has
+ ** exited and writes to the self-pipe to wake the prompt
+ ** Parameters: int signo
+ *********************************************************************/
+void catchSIGCHLD(int signo)
+{
+  int savedErrno = errno;
+
+  childExitFlag = 1;
+  write(childPipe[1], "x", 1);
+  errno = savedErrno;
+}
+
+/*********************************************************************
+ ** waitForInput
+ ** Description: Blocks at the prompt until a command line is ready on
+ ** stdin. Background jobs that finish while waiting are reported the
+ ** moment the event loop sees them and the prompt is shown again
+ ** Parameters: JobTable* jobs, char* statusMsg
+ *********************************************************************/
+void waitForInput(JobTable* jobs, char* statusMsg)
+{
+  promptShownFlag = 1;
+  while (!handleEvents(jobs, statusMsg, -1))
+  {
+    if (!promptShownFlag)  // a job was reported, show prompt again
+    {
+      putOutput(shellOutput, ": ");
+      flushOutputWriter(shellOutput);
+      promptShownFlag = 1;
+    }
+  }
+  promptShownFlag = 0;
+}
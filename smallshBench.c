@@ -0,0 +1,340 @@
+/*********************************************************************
+ ** Program Filename: smallshBench.c
+ ** Description: Benchmark driver for smallsh. Runs the shell through
+ ** scripted workloads and prints one JSON object per workload with
+ ** commands/sec, p50/p99 prompt-to-prompt latency and the shell's
+ ** peak RSS. Interactive workloads drive the shell through a pty so
+ ** that every command is timed from prompt to prompt; the batch
+ ** workload pipes a generated script into it.
+ **
+ ** Usage: smallshBench [path to smallsh] [commands per workload]
+ *********************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+struct shell
+{
+  pid_t pid;        // smallsh process
+  int   fd;         // pty master
+  char  tail[3];    // last three bytes of output, to spot the prompt
+};
+
+struct result
+{
+  const char* workload;
+  int    commands;
+  double seconds;
+  long*  latencies; // nanoseconds per command, NULL if not measured
+  double exitSeconds; // time for exit to return, 0 if not measured
+  long   peakRSS;   // kilobytes
+};
+
+// Function prototypes
+long nowNs();
+void startShell(struct shell* sh, const char* shellPath);
+void waitForPrompt(struct shell* sh);
+long runCommand(struct shell* sh, const char* line);
+long stopShell(struct shell* sh, double* exitSeconds);
+int  compareLong(const void* a, const void* b);
+void printResult(struct result* r);
+void interactiveWorkload(const char* name, const char* shellPath,
+                         int count, const char* line, int exitTimed);
+void batchWorkload(const char* shellPath, int count);
+
+/*********************************************************************
+ ** nowNs
+ ** Description: Returns CLOCK_MONOTONIC time in nanoseconds
+ ** Parameters: none
+ *********************************************************************/
+long nowNs()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/*********************************************************************
+ ** startShell
+ ** Description: Starts smallsh on a new pty with echo turned off and
+ ** waits for its first prompt
+ ** Parameters: struct shell* sh, const char* shellPath
+ *********************************************************************/
+void startShell(struct shell* sh, const char* shellPath)
+{
+  struct termios settings;
+
+  sh->pid = forkpty(&sh->fd, NULL, NULL, NULL);
+  if (sh->pid == -1)
+  {
+    perror("smallshBench: forkpty");
+    exit(1);
+  }
+  if (sh->pid == 0)
+  {
+    tcgetattr(0, &settings);
+    settings.c_lflag &= ~(ECHO|ECHONL);
+    settings.c_oflag &= ~OPOST;
+    tcsetattr(0, TCSANOW, &settings);
+    execl(shellPath, shellPath, (char*)NULL);
+    perror("smallshBench: exec");
+    _exit(127);
+  }
+
+  memset(sh->tail, '\n', sizeof(sh->tail));
+  waitForPrompt(sh);
+}
+
+/*********************************************************************
+ ** waitForPrompt
+ ** Description: Reads shell output until a ": " prompt appears at the
+ ** start of a line. Job notices such as "is done: " do not count
+ ** Parameters: struct shell* sh
+ *********************************************************************/
+void waitForPrompt(struct shell* sh)
+{
+  char buffer[4096];
+  ssize_t bytesRead,
+          i;
+
+  while (1)
+  {
+    bytesRead = read(sh->fd, buffer, sizeof(buffer));
+    if (bytesRead <= 0)
+    {
+      if (bytesRead == -1 && errno == EINTR)
+        continue;
+      fprintf(stderr, "smallshBench: shell went away\n");
+      exit(1);
+    }
+
+    for (i = 0; i < bytesRead; i++)
+    {
+      sh->tail[0] = sh->tail[1];
+      sh->tail[1] = sh->tail[2];
+      sh->tail[2] = buffer[i];
+    }
+    // A prompt right after the previous one also starts a line
+    if (sh->tail[0] == '\n' && sh->tail[1] == ':' && sh->tail[2] == ' ')
+    {
+      memset(sh->tail, '\n', sizeof(sh->tail));
+      return;
+    }
+  }
+}
+
+/*********************************************************************
+ ** runCommand
+ ** Description: Sends one command line and returns the nanoseconds
+ ** until the next prompt
+ ** Parameters: struct shell* sh, const char* line
+ *********************************************************************/
+long runCommand(struct shell* sh, const char* line)
+{
+  long start = nowNs();
+
+  if (write(sh->fd, line, strlen(line)) == -1)
+  {
+    perror("smallshBench: write");
+    exit(1);
+  }
+  waitForPrompt(sh);
+  return nowNs() - start;
+}
+
+/*********************************************************************
+ ** stopShell
+ ** Description: Sends exit, waits for the shell and returns its peak
+ ** RSS in kilobytes. Stores the time exit took in exitSeconds
+ ** Parameters: struct shell* sh, double* exitSeconds
+ *********************************************************************/
+long stopShell(struct shell* sh, double* exitSeconds)
+{
+  struct rusage usage;
+  int status;
+  long start = nowNs();
+
+  if (write(sh->fd, "exit\n", 5) == -1)
+    perror("smallshBench: write");
+  while (wait4(sh->pid, &status, 0, &usage) == -1 && errno == EINTR)
+    ;
+  *exitSeconds = (nowNs() - start) / 1e9;
+  close(sh->fd);
+  return usage.ru_maxrss;
+}
+
+/*********************************************************************
+ ** compareLong
+ ** Description: qsort comparison for longs
+ *********************************************************************/
+int compareLong(const void* a, const void* b)
+{
+  long x = *(const long*)a,
+       y = *(const long*)b;
+
+  return (x > y) - (x < y);
+}
+
+/*********************************************************************
+ ** printResult
+ ** Description: Prints a workload's result as one line of JSON
+ ** Parameters: struct result* r
+ *********************************************************************/
+void printResult(struct result* r)
+{
+  printf("{\"workload\": \"%s\", \"commands\": %d, \"seconds\": %.4f, "
+         "\"commands_per_sec\": %.1f", r->workload, r->commands,
+         r->seconds, r->seconds > 0 ? r->commands / r->seconds : 0.0);
+
+  if (r->latencies != NULL)
+  {
+    qsort(r->latencies, r->commands, sizeof(long), compareLong);
+    printf(", \"p50_us\": %.1f, \"p99_us\": %.1f",
+           r->latencies[r->commands / 2] / 1e3,
+           r->latencies[(int)(r->commands * 0.99)] / 1e3);
+  }
+  if (r->exitSeconds > 0)
+    printf(", \"exit_seconds\": %.4f", r->exitSeconds);
+  printf(", \"peak_rss_kb\": %ld}\n", r->peakRSS);
+  fflush(stdout);
+}
+
+/*********************************************************************
+ ** interactiveWorkload
+ ** Description: Runs the command line count times through an
+ ** interactive shell, timing each from prompt to prompt. If
+ ** exitTimed is set, exit is timed separately from the commands
+ ** Parameters: const char* name, const char* shellPath, int count,
+ ** const char* line, int exitTimed
+ *********************************************************************/
+void interactiveWorkload(const char* name, const char* shellPath,
+                         int count, const char* line, int exitTimed)
+{
+  struct shell sh;
+  struct result r;
+  double exitSeconds;
+  long start;
+  int i;
+
+  r.workload = name;
+  r.commands = count;
+  r.latencies = malloc(sizeof(long) * count);
+  r.exitSeconds = 0;
+
+  startShell(&sh, shellPath);
+  start = nowNs();
+  for (i = 0; i < count; i++)
+    r.latencies[i] = runCommand(&sh, line);
+  r.seconds = (nowNs() - start) / 1e9;
+  r.peakRSS = stopShell(&sh, &exitSeconds);
+  if (exitTimed)
+    r.exitSeconds = exitSeconds;
+
+  printResult(&r);
+  free(r.latencies);
+}
+
+/*********************************************************************
+ ** batchWorkload
+ ** Description: Pipes a script of count `true` commands into the
+ ** shell in batch mode and times the whole run
+ ** Parameters: const char* shellPath, int count
+ *********************************************************************/
+void batchWorkload(const char* shellPath, int count)
+{
+  struct result r;
+  struct rusage usage;
+  int scriptPipe[2],
+      nullFd,
+      status,
+      i;
+  pid_t pid;
+  long start;
+  FILE* script;
+
+  if (pipe(scriptPipe) == -1)
+  {
+    perror("smallshBench: pipe");
+    exit(1);
+  }
+
+  start = nowNs();
+  pid = fork();
+  if (pid == 0)
+  {
+    dup2(scriptPipe[0], 0);
+    close(scriptPipe[0]);
+    close(scriptPipe[1]);
+    nullFd = open("/dev/null", O_WRONLY);
+    if (nullFd != -1)
+      dup2(nullFd, 1);
+    execl(shellPath, shellPath, (char*)NULL);
+    _exit(127);
+  }
+  close(scriptPipe[0]);
+
+  script = fdopen(scriptPipe[1], "w");
+  for (i = 0; i < count; i++)
+    fputs("true\n", script);
+  fputs("exit\n", script);
+  fclose(script);
+
+  while (wait4(pid, &status, 0, &usage) == -1 && errno == EINTR)
+    ;
+
+  r.workload = "batch_true";
+  r.commands = count;
+  r.seconds = (nowNs() - start) / 1e9;
+  r.latencies = NULL;
+  r.exitSeconds = 0;
+  r.peakRSS = usage.ru_maxrss;
+  printResult(&r);
+}
+
+int main(int argc, char* argv[])
+{
+  const char* shellPath = argc > 1 ? argv[1] : "./smallsh";
+  int count = argc > 2 ? atoi(argv[2]) : 2000;
+  char scratch[64],
+       line[160];
+
+  if (count <= 0)
+  {
+    fprintf(stderr, "usage: smallshBench [smallsh] [commands]\n");
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  // Keep benchmark commands out of the user's history
+  setenv("HISTFILE", "/dev/null", 1);
+
+  snprintf(scratch, sizeof(scratch), "/tmp/smallshBench.%d", getpid());
+
+  interactiveWorkload("true", shellPath, count, "true\n", 0);
+
+  snprintf(line, sizeof(line), "wc -c < /etc/passwd > %s\n", scratch);
+  interactiveWorkload("redirect", shellPath, count, line, 0);
+
+  interactiveWorkload("background_flood", shellPath, count, "true &\n", 0);
+
+  interactiveWorkload("exit_many_jobs", shellPath, count / 10 > 0 ?
+                      count / 10 : 1, "sleep 1000 &\n", 1);
+
+  batchWorkload(shellPath, count * 5);
+
+  unlink(scratch);
+  return 0;
+}
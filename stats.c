@@ -0,0 +1,211 @@
+/*********************************************************************
+ ** Program Filename: stats.c
+ ** Description: Counters and latency histograms for the shell's hot
+ ** path. Each probe keeps a count, a total, a maximum and a histogram
+ ** with one bucket per power of two nanoseconds, so recording is a
+ ** few additions and percentiles are known to within a factor of
+ ** two. The counters live in a shared anonymous mapping, so a forked
+ ** child whose exec fails can record that before it exits; updates
+ ** are atomic for the same reason. Nothing is allocated or timed
+ ** until stats are first enabled.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "stats.h"
+
+#define STAT_BUCKETS 40 // 2^39 ns is over nine minutes
+
+struct probe
+{
+  long count;
+  long totalNs;
+  long maxNs;
+  long buckets[STAT_BUCKETS]; // bucket b holds [2^(b-1), 2^b) ns
+};
+
+static const char* probeNames[STAT_PROBES] =
+{
+  "read", "parse", "launch", "exec_fail", "wait", "sweep"
+};
+
+int statsFlag = 0;
+static struct probe* probes = NULL; // shared mapping, NULL until enabled
+
+/*********************************************************************
+ ** enableStats
+ ** Description: Maps the counters on first use and turns timing on
+ ** Parameters: none
+ *********************************************************************/
+int enableStats()
+{
+  void* map;
+
+  if (probes == NULL)
+  {
+    map = mmap(NULL, sizeof(struct probe) * STAT_PROBES,
+               PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+      return -1;
+    probes = map; // zero-filled
+  }
+  statsFlag = 1;
+  return 0;
+}
+
+/*********************************************************************
+ ** disableStats
+ ** Description: Turns timing off. The counts are kept for printing
+ ** Parameters: none
+ *********************************************************************/
+void disableStats()
+{
+  statsFlag = 0;
+}
+
+/*********************************************************************
+ ** resetStats
+ ** Description: Zeroes every probe
+ ** Parameters: none
+ *********************************************************************/
+void resetStats()
+{
+  if (probes != NULL)
+    memset(probes, 0, sizeof(struct probe) * STAT_PROBES);
+}
+
+/*********************************************************************
+ ** nowStatNs
+ ** Description: Returns CLOCK_MONOTONIC time in nanoseconds
+ ** Parameters: none
+ *********************************************************************/
+long nowStatNs()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/*********************************************************************
+ ** recordStat
+ ** Description: Adds one event lasting from startNs until now
+ ** Parameters: int probe, long startNs
+ *********************************************************************/
+void recordStat(int probe, long startNs)
+{
+  struct probe* p;
+  long ns = nowStatNs() - startNs,
+       max;
+  int bucket;
+
+  if (probes == NULL)
+    return;
+  if (ns < 0)
+    ns = 0;
+  bucket = (ns == 0) ? 0 : 64 - __builtin_clzl(ns);
+  if (bucket >= STAT_BUCKETS)
+    bucket = STAT_BUCKETS - 1;
+
+  p = &probes[probe];
+  __atomic_add_fetch(&p->count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&p->totalNs, ns, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&p->buckets[bucket], 1, __ATOMIC_RELAXED);
+  max = __atomic_load_n(&p->maxNs, __ATOMIC_RELAXED);
+  while (ns > max &&
+         !__atomic_compare_exchange_n(&p->maxNs, &max, ns, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/*********************************************************************
+ ** _percentileUs
+ ** Description: Returns the upper bound, in microseconds, of the
+ ** bucket holding the given fraction of a probe's events, no more
+ ** than the maximum seen
+ ** Parameters: struct probe* p, double fraction
+ *********************************************************************/
+static double _percentileUs(struct probe* p, double fraction)
+{
+  long rank = (long)(fraction * p->count + 0.999999),
+       seen = 0;
+  int bucket;
+
+  if (rank < 1)
+    rank = 1;
+  for (bucket = 0; bucket < STAT_BUCKETS - 1; bucket++)
+  {
+    seen += p->buckets[bucket];
+    if (seen >= rank)
+      break;
+  }
+  if (bucket == 0)
+    return 0;
+  if (bucket == STAT_BUCKETS - 1 || (1L << bucket) > p->maxNs)
+    return p->maxNs / 1e3;
+  return (1L << bucket) / 1e3;
+}
+
+/*********************************************************************
+ ** printStats
+ ** Description: Prints one line per probe; one with no events yet
+ ** shows only its zero count
+ ** Parameters: OutputWriter* w
+ *********************************************************************/
+void printStats(OutputWriter* w)
+{
+  struct probe* p;
+  int i;
+
+  printOutput(w, "%-10s %10s %10s %10s %10s %10s\n", "probe", "count",
+              "mean_us", "p50_us", "p99_us", "max_us");
+  for (i = 0; i < STAT_PROBES; i++)
+  {
+    if (probes == NULL || probes[i].count == 0)
+    {
+      printOutput(w, "%-10s %10d\n", probeNames[i], 0);
+      continue;
+    }
+    p = &probes[i];
+    printOutput(w, "%-10s %10ld %10.1f %10.1f %10.1f %10.1f\n",
+                probeNames[i], p->count, p->totalNs / 1e3 / p->count,
+                _percentileUs(p, 0.50), _percentileUs(p, 0.99),
+                p->maxNs / 1e3);
+  }
+}
+
+/*********************************************************************
+ ** dumpStats
+ ** Description: Writes the table to path.tmp and renames it to path
+ ** Parameters: const char* path
+ *********************************************************************/
+int dumpStats(const char* path)
+{
+  OutputWriter* w;
+  char tempPath[4096];
+  int fd,
+      result;
+
+  if (snprintf(tempPath, sizeof(tempPath), "%s.tmp", path) >=
+      (int)sizeof(tempPath))
+    return -1;
+  fd = open(tempPath, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+  if (fd == -1)
+    return -1;
+
+  w = createOutputWriter(fd, 4096);
+  printStats(w);
+  result = flushOutputWriter(w);
+  deleteOutputWriter(w);
+  if (close(fd) == -1 || result == -1 || rename(tempPath, path) == -1)
+  {
+    unlink(tempPath);
+    return -1;
+  }
+  return 0;
+}
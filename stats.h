@@ -0,0 +1,54 @@
+/* 	stats.h : Hot-path counters and latency histograms. */
+#ifndef STATS_INCLUDED
+#define STATS_INCLUDED 1
+
+#include "outputWriter.h"
+
+/* Probes, each a count of events and a histogram of their durations */
+#define STAT_READ      0  /* reading a command line */
+#define STAT_PARSE     1  /* lexing it and reading its prefixes */
+#define STAT_LAUNCH    2  /* starting one process, by spawn or fork */
+#define STAT_EXEC_FAIL 3  /* a forked child's failed exec, from fork */
+#define STAT_WAIT      4  /* waiting for a foreground command */
+#define STAT_SWEEP     5  /* reaping sweep after SIGCHLD */
+#define STAT_PROBES    6
+
+/* Set while timing is on. Read directly so the probes cost one test
+   when it is off. */
+extern int statsFlag;
+
+/* Turns timing on, keeping any earlier counts. Returns 0, or -1 if
+   the counters cannot be allocated. */
+int enableStats();
+void disableStats();
+void resetStats();
+
+/* Returns CLOCK_MONOTONIC time in nanoseconds */
+long nowStatNs();
+
+/* Records one event of a probe that began at startNs */
+void recordStat(int probe, long startNs);
+
+/* Returns a start time for endStat(), or 0 while timing is off */
+static inline long startStat()
+{
+  return statsFlag ? nowStatNs() : 0;
+}
+
+/* Records the event begun at start, unless timing was off then */
+static inline void endStat(int probe, long start)
+{
+  if (start != 0 && statsFlag)
+    recordStat(probe, start);
+}
+
+/* Prints a table of the probes: count, mean, median, 99th percentile
+   and maximum in microseconds. */
+void printStats(OutputWriter *w);
+
+/* Replaces the file at path with the table, through a temporary file
+   renamed over it so readers never see a partial one. Returns 0, or
+   -1 if it cannot be written. */
+int dumpStats(const char *path);
+
+#endif
@@ -0,0 +1,832 @@
+/*********************************************************************
+ ** Program Filename: utilities.c
+ ** Description: echo, true, false, pwd, test (and [), printf and sleep
+ ** run inside the shell, so scripts full of them do not pay for a
+ ** process each time. They write to descriptors 0 to 2 as the shell
+ ** has redirected them and are looked up by built-in number in a
+ ** table. Behaviour follows the POSIX utilities; the GNU extensions
+ ** kept are echo -e/-E and sleep's m, h and d suffixes.
+ *********************************************************************/
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "lexer.h"
+#include "utilities.h"
+
+typedef int (*Utility)(char** arg);
+
+static int _echo(char** arg);
+static int _true(char** arg);
+static int _false(char** arg);
+static int _pwd(char** arg);
+static int _test(char** arg);
+static int _printf(char** arg);
+static int _sleep(char** arg);
+
+// Indexed by built-in number, starting from BUILTIN_ECHO
+static Utility _utilities[] = {
+  _echo,   // BUILTIN_ECHO
+  _true,   // BUILTIN_TRUE
+  _false,  // BUILTIN_FALSE
+  _pwd,    // BUILTIN_PWD
+  _test,   // BUILTIN_TEST
+  _printf, // BUILTIN_PRINTF
+  _sleep   // BUILTIN_SLEEP
+};
+
+static volatile sig_atomic_t _interruptSignal = 0; // set by SIGINT
+
+static char** _testArg;  // next argument of a test expression
+static char** _testEnd;  // one past its last argument
+static int    _testError; // set once the expression is found malformed
+
+/*********************************************************************
+ ** isUtility
+ ** Description: Returns true (1) if the built-in is a utility
+ ** Parameters: int builtin
+ *********************************************************************/
+int isUtility(int builtin)
+{
+  return builtin >= BUILTIN_ECHO && builtin <= BUILTIN_SLEEP;
+}
+
+/*********************************************************************
+ ** runUtility
+ ** Description: Runs a utility and flushes what it wrote, so nothing
+ ** is left buffered once the shell puts its descriptors back. Returns
+ ** the exit value as a wait status, or the signal for a sleep cut
+ ** short by SIGINT
+ ** Parameters: int builtin, char** arg
+ *********************************************************************/
+int runUtility(int builtin, char** arg)
+{
+  int exitValue;
+
+  _interruptSignal = 0;
+  exitValue = _utilities[builtin - BUILTIN_ECHO](arg);
+
+  // Output that could not be written is dropped, not kept for later
+  if (fflush(stdout) == EOF)
+  {
+    fprintf(stderr, "%s: write error: %s\n", arg[0], strerror(errno));
+    __fpurge(stdout);
+    clearerr(stdout);
+    exitValue = 1;
+  }
+
+  if (_interruptSignal)
+    return _interruptSignal;
+  return W_EXITCODE(exitValue & 0xff, 0);
+}
+
+/*********************************************************************
+ ** _putEscape
+ ** Description: Writes the character for the backslash escape at
+ ** *text (just past the backslash) and moves *text past it. Octal
+ ** escapes are \nnn in printf formats and \0nnn for echo and %b.
+ ** Returns 1 for \c, which ends all output
+ ** Parameters: const char** text, int zeroOctalFlag
+ *********************************************************************/
+static int _putEscape(const char** text, int zeroOctalFlag)
+{
+  const char* p = *text;
+  int value = 0,
+      digits = 0;
+
+  switch (*p)
+  {
+    case 'a':  putchar('\a'); break;
+    case 'b':  putchar('\b'); break;
+    case 'e':  putchar('\033'); break;
+    case 'f':  putchar('\f'); break;
+    case 'n':  putchar('\n'); break;
+    case 'r':  putchar('\r'); break;
+    case 't':  putchar('\t'); break;
+    case 'v':  putchar('\v'); break;
+    case '\\': putchar('\\'); break;
+    case 'c':
+      *text = p + 1;
+      return 1;
+
+    case 'x':
+      for (p++; digits < 2 && isxdigit((unsigned char)*p); p++, digits++)
+        value = value * 16 + (isdigit((unsigned char)*p) ? *p - '0' :
+                              (*p | 0x20) - 'a' + 10);
+      if (digits == 0)
+        fputs("\\x", stdout);
+      else
+        putchar(value);
+      *text = p;
+      return 0;
+
+    default:
+      if (zeroOctalFlag ? *p == '0' : (*p >= '0' && *p <= '7'))
+      {
+        if (zeroOctalFlag)
+          p++;
+        for (; digits < 3 && *p >= '0' && *p <= '7'; p++, digits++)
+          value = value * 8 + *p - '0';
+        putchar(value & 0xff);
+        *text = p;
+        return 0;
+      }
+
+      // Not an escape: the backslash stands for itself
+      putchar('\\');
+      if (*p == '\0')
+      {
+        *text = p;
+        return 0;
+      }
+      putchar(*p);
+      break;
+  }
+  *text = p + 1;
+  return 0;
+}
+
+/*********************************************************************
+ ** _echo
+ ** Description: Writes the arguments separated by spaces. Leading
+ ** -n drops the newline; -e turns on backslash escapes and -E off
+ ** Parameters: char** arg
+ *********************************************************************/
+static int _echo(char** arg)
+{
+  const char* option;
+  const char* text;
+  int newlineFlag = 1,
+      escapeFlag = 0,
+      first,
+      i;
+
+  // An option word made only of n, e and E letters
+  for (i = 1; arg[i] != NULL && arg[i][0] == '-' && arg[i][1] != '\0' &&
+              strspn(arg[i] + 1, "neE") == strlen(arg[i] + 1); i++)
+  {
+    for (option = arg[i] + 1; *option != '\0'; option++)
+    {
+      if (*option == 'n')
+        newlineFlag = 0;
+      else
+        escapeFlag = (*option == 'e');
+    }
+  }
+
+  for (first = i; arg[i] != NULL; i++)
+  {
+    if (i > first)
+      putchar(' ');
+    if (!escapeFlag)
+    {
+      fputs(arg[i], stdout);
+      continue;
+    }
+    for (text = arg[i]; *text != '\0'; )
+    {
+      if (*text != '\\')
+        putchar(*text++);
+      else if (text++, _putEscape(&text, 1))
+        return 0;
+    }
+  }
+
+  if (newlineFlag)
+    putchar('\n');
+  return 0;
+}
+
+/*********************************************************************
+ ** _true
+ ** Description: Succeeds
+ ** Parameters: char** arg
+ *********************************************************************/
+static int _true(char** arg)
+{
+  return 0;
+}
+
+/*********************************************************************
+ ** _false
+ ** Description: Fails
+ ** Parameters: char** arg
+ *********************************************************************/
+static int _false(char** arg)
+{
+  return 1;
+}
+
+/*********************************************************************
+ ** _pwd
+ ** Description: Writes the current working directory
+ ** Parameters: char** arg
+ *********************************************************************/
+static int _pwd(char** arg)
+{
+  char directory[PATH_MAX];
+
+  if (getcwd(directory, sizeof(directory)) == NULL)
+  {
+    fprintf(stderr, "pwd: %s\n", strerror(errno));
+    return 1;
+  }
+  puts(directory);
+  return 0;
+}
+
+/*********************************************************************
+ ** _testFail
+ ** Description: Reports a malformed test expression, once
+ ** Parameters: const char* message, const char* word (may be NULL)
+ *********************************************************************/
+static void _testFail(const char* message, const char* word)
+{
+  if (_testError)
+    return;
+  _testError = 1;
+  if (word != NULL)
+    fprintf(stderr, "test: %s: %s\n", word, message);
+  else
+    fprintf(stderr, "test: %s\n", message);
+}
+
+/*********************************************************************
+ ** _isUnary
+ ** Description: Returns true (1) for a unary test operator
+ ** Parameters: const char* word
+ *********************************************************************/
+static int _isUnary(const char* word)
+{
+  return word[0] == '-' && word[1] != '\0' && word[2] == '\0' &&
+         strchr("bcdefghLnprsStuwxz", word[1]) != NULL;
+}
+
+/*********************************************************************
+ ** _isBinary
+ ** Description: Returns true (1) for a binary test operator
+ ** Parameters: const char* word
+ *********************************************************************/
+static int _isBinary(const char* word)
+{
+  static const char* operators[] = {
+    "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt",
+    "-ge", "-nt", "-ot", "-ef", NULL
+  };
+  int i;
+
+  for (i = 0; operators[i] != NULL; i++)
+    if (strcmp(word, operators[i]) == 0)
+      return 1;
+  return 0;
+}
+
+/*********************************************************************
+ ** _testInteger
+ ** Description: Parses an integer operand, allowing surrounding
+ ** blanks. Reports an error and returns 0 if it is not one
+ ** Parameters: const char* text
+ *********************************************************************/
+static long long _testInteger(const char* text)
+{
+  long long value;
+  char* end;
+
+  errno = 0;
+  value = strtoll(text, &end, 10);
+  while (*end == ' ' || *end == '\t')
+    end++;
+  if (end == text || *end != '\0' || errno != 0)
+  {
+    _testFail("integer expression expected", text);
+    return 0;
+  }
+  return value;
+}
+
+/*********************************************************************
+ ** _testUnary
+ ** Description: Evaluates a unary test such as -f file or -z string
+ ** Parameters: const char* operator, const char* operand
+ *********************************************************************/
+static int _testUnary(const char* operator, const char* operand)
+{
+  struct stat info;
+
+  switch (operator[1])
+  {
+    case 'z': return operand[0] == '\0';
+    case 'n': return operand[0] != '\0';
+    case 't': return isatty((int)_testInteger(operand));
+    case 'r': return access(operand, R_OK) == 0;
+    case 'w': return access(operand, W_OK) == 0;
+    case 'x': return access(operand, X_OK) == 0;
+    case 'h':
+    case 'L': return lstat(operand, &info) == 0 && S_ISLNK(info.st_mode);
+  }
+
+  if (stat(operand, &info) == -1)
+    return 0;
+  switch (operator[1])
+  {
+    case 'b': return S_ISBLK(info.st_mode);
+    case 'c': return S_ISCHR(info.st_mode);
+    case 'd': return S_ISDIR(info.st_mode);
+    case 'f': return S_ISREG(info.st_mode);
+    case 'p': return S_ISFIFO(info.st_mode);
+    case 'S': return S_ISSOCK(info.st_mode);
+    case 's': return info.st_size > 0;
+    case 'g': return (info.st_mode & S_ISGID) != 0;
+    case 'u': return (info.st_mode & S_ISUID) != 0;
+  }
+  return 1; // -e
+}
+
+/*********************************************************************
+ ** _testBinary
+ ** Description: Evaluates a binary test: string and integer
+ ** comparisons, and file age (-nt, -ot) and identity (-ef)
+ ** Parameters: const char* left, const char* operator,
+ ** const char* right
+ *********************************************************************/
+static int _testBinary(const char* left, const char* operator,
+                       const char* right)
+{
+  struct stat leftInfo,
+              rightInfo;
+  int leftFound,
+      rightFound;
+  long long leftValue,
+            rightValue;
+
+  if (operator[0] != '-')
+  {
+    switch (operator[0])
+    {
+      case '=': return strcmp(left, right) == 0;
+      case '!': return strcmp(left, right) != 0;
+      case '<': return strcmp(left, right) < 0;
+      default:  return strcmp(left, right) > 0;
+    }
+  }
+
+  // File comparisons: a file that exists is newer than one that
+  // does not
+  if ((operator[1] == 'n' && operator[2] == 't') || operator[1] == 'o' ||
+      (operator[1] == 'e' && operator[2] == 'f'))
+  {
+    leftFound = (stat(left, &leftInfo) == 0);
+    rightFound = (stat(right, &rightInfo) == 0);
+    if (operator[1] == 'e')
+      return leftFound && rightFound && leftInfo.st_dev == rightInfo.st_dev
+             && leftInfo.st_ino == rightInfo.st_ino;
+    if (!leftFound || !rightFound)
+      return operator[1] == 'n' ? leftFound : rightFound;
+    if (leftInfo.st_mtim.tv_sec != rightInfo.st_mtim.tv_sec)
+      return operator[1] == 'n' ?
+             leftInfo.st_mtim.tv_sec > rightInfo.st_mtim.tv_sec :
+             leftInfo.st_mtim.tv_sec < rightInfo.st_mtim.tv_sec;
+    return operator[1] == 'n' ?
+           leftInfo.st_mtim.tv_nsec > rightInfo.st_mtim.tv_nsec :
+           leftInfo.st_mtim.tv_nsec < rightInfo.st_mtim.tv_nsec;
+  }
+
+  leftValue = _testInteger(left);
+  rightValue = _testInteger(right);
+  if (strcmp(operator, "-eq") == 0) return leftValue == rightValue;
+  if (strcmp(operator, "-ne") == 0) return leftValue != rightValue;
+  if (strcmp(operator, "-lt") == 0) return leftValue < rightValue;
+  if (strcmp(operator, "-le") == 0) return leftValue <= rightValue;
+  if (strcmp(operator, "-gt") == 0) return leftValue > rightValue;
+  return leftValue >= rightValue;
+}
+
+static int _testOr();
+
+/*********************************************************************
+ ** _testPrimary
+ ** Description: Evaluates a binary or unary test, a parenthesized
+ ** expression or a lone string (true if not empty). A binary
+ ** operator in second place wins, as POSIX requires for three
+ ** arguments, so [ -n = -n ] compares two strings
+ ** Parameters: none
+ *********************************************************************/
+static int _testPrimary()
+{
+  long left = _testEnd - _testArg;
+  int value;
+
+  if (left == 0)
+  {
+    _testFail("argument expected", NULL);
+    return 0;
+  }
+  if (left >= 3 && _isBinary(_testArg[1]))
+  {
+    value = _testBinary(_testArg[0], _testArg[1], _testArg[2]);
+    _testArg += 3;
+    return value;
+  }
+  if (left >= 2 && strcmp(_testArg[0], "(") == 0)
+  {
+    _testArg++;
+    value = _testOr();
+    if (_testArg == _testEnd || strcmp(_testArg[0], ")") != 0)
+      _testFail("')' expected", NULL);
+    else
+      _testArg++;
+    return value;
+  }
+  if (left >= 2 && _isUnary(_testArg[0]))
+  {
+    value = _testUnary(_testArg[0], _testArg[1]);
+    _testArg += 2;
+    return value;
+  }
+  return (*_testArg++)[0] != '\0';
+}
+
+/*********************************************************************
+ ** _testNot
+ ** Description: Evaluates a primary, negated by each leading ! that
+ ** has something after it
+ ** Parameters: none
+ *********************************************************************/
+static int _testNot()
+{
+  long left = _testEnd - _testArg;
+
+  if (left >= 2 && strcmp(_testArg[0], "!") == 0 &&
+      !(left >= 3 && _isBinary(_testArg[1])))
+  {
+    _testArg++;
+    return !_testNot();
+  }
+  return _testPrimary();
+}
+
+/*********************************************************************
+ ** _testAnd
+ ** Description: Evaluates negations joined by -a
+ ** Parameters: none
+ *********************************************************************/
+static int _testAnd()
+{
+  int value = _testNot();
+
+  while (_testArg < _testEnd && strcmp(_testArg[0], "-a") == 0)
+  {
+    _testArg++;
+    value = _testNot() && value;
+  }
+  return value;
+}
+
+/*********************************************************************
+ ** _testOr
+ ** Description: Evaluates -a groups joined by -o, which binds less
+ ** tightly
+ ** Parameters: none
+ *********************************************************************/
+static int _testOr()
+{
+  int value = _testAnd();
+
+  while (_testArg < _testEnd && strcmp(_testArg[0], "-o") == 0)
+  {
+    _testArg++;
+    value = _testAnd() || value;
+  }
+  return value;
+}
+
+/*********************************************************************
+ ** _test
+ ** Description: Evaluates a test expression. Exits 0 if it is true,
+ ** 1 if it is false or empty and 2 if it is malformed. As [ the last
+ ** argument must be ]
+ ** Parameters: char** arg
+ *********************************************************************/
+static int _test(char** arg)
+{
+  int count,
+      value;
+
+  for (count = 1; arg[count] != NULL; count++)
+    ;
+  if (strcmp(arg[0], "[") == 0)
+  {
+    if (strcmp(arg[count - 1], "]") != 0 || count == 1)
+    {
+      fprintf(stderr, "[: missing ]\n");
+      return 2;
+    }
+    count--;
+  }
+  if (count == 1)
+    return 1;
+
+  _testArg = arg + 1;
+  _testEnd = arg + count;
+  _testError = 0;
+  value = _testOr();
+  if (_testArg != _testEnd)
+    _testFail("unexpected argument", _testArg[0]);
+  return _testError ? 2 : !value;
+}
+
+/*********************************************************************
+ ** _nextArgument
+ ** Description: Returns the next printf argument, or "" when they
+ ** have run out
+ ** Parameters: char*** args
+ *********************************************************************/
+static const char* _nextArgument(char*** args)
+{
+  if (**args == NULL)
+    return "";
+  return *(*args)++;
+}
+
+/*********************************************************************
+ ** _numberArgument
+ ** Description: Converts a printf argument to an integer. A leading
+ ** quote gives the value of the next character. Reports an invalid
+ ** number and sets the exit value, but still uses what was parsed
+ ** Parameters: const char* text, int* exitValue
+ *********************************************************************/
+static long long _numberArgument(const char* text, int* exitValue)
+{
+  long long value;
+  char* end;
+
+  if (text[0] == '\'' || text[0] == '"')
+    return (unsigned char)text[1];
+  if (text[0] == '\0')
+    return 0;
+
+  errno = 0;
+  value = strtoll(text, &end, 0);
+  if (end == text || *end != '\0' || errno != 0)
+  {
+    fprintf(stderr, "printf: %s: invalid number\n", text);
+    *exitValue = 1;
+  }
+  return value;
+}
+
+/*********************************************************************
+ ** _doubleArgument
+ ** Description: Converts a printf argument to a floating point number
+ ** Parameters: const char* text, int* exitValue
+ *********************************************************************/
+static double _doubleArgument(const char* text, int* exitValue)
+{
+  double value;
+  char* end;
+
+  if (text[0] == '\'' || text[0] == '"')
+    return (unsigned char)text[1];
+  if (text[0] == '\0')
+    return 0;
+
+  value = strtod(text, &end);
+  if (end == text || *end != '\0')
+  {
+    fprintf(stderr, "printf: %s: invalid number\n", text);
+    *exitValue = 1;
+  }
+  return value;
+}
+
+/*********************************************************************
+ ** _printFormat
+ ** Description: Writes the format once, taking arguments for its
+ ** conversions as it goes. Each conversion is rebuilt with a C
+ ** length modifier and handed to printf(). Returns 1 if output has
+ ** to stop (\c, or an invalid conversion)
+ ** Parameters: const char* format, char*** args, int* exitValue
+ *********************************************************************/
+static int _printFormat(const char* format, char*** args, int* exitValue)
+{
+  const char* p = format;
+  const char* argument;
+  char spec[32];
+  size_t length;
+  char conversion;
+
+  while (*p != '\0')
+  {
+    if (*p == '\\')
+    {
+      p++;
+      if (_putEscape(&p, 0))
+        return 1;
+      continue;
+    }
+    if (*p != '%')
+    {
+      putchar(*p++);
+      continue;
+    }
+    if (p[1] == '%')
+    {
+      putchar('%');
+      p += 2;
+      continue;
+    }
+
+    // Copy the flags, width and precision; * takes one from the
+    // arguments
+    length = 0;
+    spec[length++] = *p++;
+    while (*p != '\0' && strchr("-+ #0123456789.*", *p) != NULL &&
+           length < sizeof(spec) - 16)
+    {
+      if (*p == '*')
+        length += sprintf(spec + length, "%d",
+                          (int)_numberArgument(_nextArgument(args),
+                                               exitValue));
+      else
+        spec[length++] = *p;
+      p++;
+    }
+
+    // A % at the end of the format has no conversion to name
+    conversion = *p;
+    if (conversion == '\0')
+    {
+      fprintf(stderr, "printf: %.*s: missing conversion\n", (int)length,
+              spec);
+      *exitValue = 1;
+      return 1;
+    }
+    p++;
+    argument = _nextArgument(args);
+    switch (conversion)
+    {
+      case 'd':
+      case 'i':
+        strcpy(spec + length, "lld");
+        printf(spec, _numberArgument(argument, exitValue));
+        break;
+
+      case 'o':
+      case 'u':
+      case 'x':
+      case 'X':
+        sprintf(spec + length, "ll%c", conversion);
+        printf(spec, (unsigned long long)_numberArgument(argument,
+                                                         exitValue));
+        break;
+
+      case 'a': case 'A':
+      case 'e': case 'E':
+      case 'f': case 'F':
+      case 'g': case 'G':
+        sprintf(spec + length, "%c", conversion);
+        printf(spec, _doubleArgument(argument, exitValue));
+        break;
+
+      case 'c':
+        strcpy(spec + length, "c");
+        if (argument[0] != '\0')
+          printf(spec, argument[0]);
+        break;
+
+      case 's':
+        strcpy(spec + length, "s");
+        printf(spec, argument);
+        break;
+
+      case 'b': // the argument's escapes are expanded
+        while (*argument != '\0')
+        {
+          if (*argument != '\\')
+            putchar(*argument++);
+          else if (argument++, _putEscape(&argument, 1))
+            return 1;
+        }
+        break;
+
+      default:
+        fprintf(stderr, "printf: %%%c: invalid conversion\n", conversion);
+        *exitValue = 1;
+        return 1;
+    }
+  }
+  return 0;
+}
+
+/*********************************************************************
+ ** _printf
+ ** Description: Writes the arguments under control of the format.
+ ** The format is reused while arguments remain and it took some
+ ** Parameters: char** arg
+ *********************************************************************/
+static int _printf(char** arg)
+{
+  char** args;
+  char** before;
+  int exitValue = 0;
+
+  if (arg[1] == NULL)
+  {
+    fprintf(stderr, "printf: missing operand\n");
+    return 1;
+  }
+
+  args = arg + 2;
+  do
+  {
+    before = args;
+    if (_printFormat(arg[1], &args, &exitValue))
+      break;
+  } while (*args != NULL && args != before);
+  return exitValue;
+}
+
+/*********************************************************************
+ ** _catchInterrupt
+ ** Description: SIGINT handler while sleeping
+ ** Parameters: int signo
+ *********************************************************************/
+static void _catchInterrupt(int signo)
+{
+  _interruptSignal = signo;
+}
+
+/*********************************************************************
+ ** _sleep
+ ** Description: Sleeps for the sum of its arguments, each a number of
+ ** seconds (fractions allowed) with an optional s, m, h or d suffix.
+ ** The shell ignores SIGINT, so it is caught here for the length of
+ ** the sleep to let Ctrl-C cut it short
+ ** Parameters: char** arg
+ *********************************************************************/
+static int _sleep(char** arg)
+{
+  struct sigaction interrupt,
+                   saved;
+  struct timespec remaining;
+  double seconds = 0,
+         value,
+         scale;
+  char* end;
+  int i;
+
+  if (arg[1] == NULL)
+  {
+    fprintf(stderr, "sleep: missing operand\n");
+    return 1;
+  }
+
+  for (i = 1; arg[i] != NULL; i++)
+  {
+    value = strtod(arg[i], &end);
+    switch (*end)
+    {
+      case '\0':
+      case 's': scale = 1; break;
+      case 'm': scale = 60; break;
+      case 'h': scale = 3600; break;
+      case 'd': scale = 86400; break;
+      default:  scale = -1; break;
+    }
+    if (end == arg[i] || scale < 0 || (*end != '\0' && end[1] != '\0') ||
+        !(value >= 0))
+    {
+      fprintf(stderr, "sleep: invalid time interval '%s'\n", arg[i]);
+      return 1;
+    }
+    seconds += value * scale;
+  }
+
+  if (seconds > INT_MAX)
+    seconds = INT_MAX;
+  remaining.tv_sec = (time_t)seconds;
+  remaining.tv_nsec = (long)((seconds - remaining.tv_sec) * 1e9);
+
+  memset(&interrupt, 0, sizeof(interrupt));
+  interrupt.sa_handler = _catchInterrupt;
+  sigemptyset(&interrupt.sa_mask);
+  sigaction(SIGINT, &interrupt, &saved);
+
+  // Other signals (SIGCHLD from background jobs) only pause it
+  while (nanosleep(&remaining, &remaining) == -1 && errno == EINTR &&
+         !_interruptSignal)
+    ;
+
+  sigaction(SIGINT, &saved, NULL);
+  return 0;
+}
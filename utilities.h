@@ -0,0 +1,14 @@
+/* 	utilities.h : Common utilities run inside the shell process. */
+#ifndef UTILITIES_INCLUDED
+#define UTILITIES_INCLUDED 1
+
+/* Returns true (1) if the built-in from classifyBuiltin() is one of
+   the utilities (echo, true, false, pwd, test and [, printf, sleep) */
+int isUtility(int builtin);
+
+/* Runs a utility with its NULL-terminated arguments on descriptors 0
+   to 2 as they stand. Returns a wait status, as waitpid() would have
+   given for the external command. */
+int runUtility(int builtin, char **arg);
+
+#endif
@@ -0,0 +1,414 @@
+/*********************************************************************
+ ** Program Filename: varTable.c
+ ** Description: Hash table of shell variables, looked up by name for
+ ** $NAME expansion while a line is tokenized. Each variable is kept
+ ** as one "NAME=value" string, so the environment handed to exec is
+ ** just an array of pointers to the exported ones. That array is
+ ** built once and reused for every command until an exported
+ ** variable changes, rather than rebuilt per command.
+ *********************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "varTable.h"
+
+struct varEntry
+{
+  char*    pair;       // "NAME=value", NULL if the slot is empty
+  size_t   nameLength; // length of NAME
+  unsigned hash;       // hash of NAME
+  int      exportFlag; // set if the variable is passed to commands
+};
+
+struct VarTable
+{
+  struct varEntry* entries; // open-addressing table
+  int    numSlots;          // always a power of two
+  int    size;              // number of variables set
+  char** envp;              // exported pairs, NULL-terminated
+  int    envpCapacity;      // pointers envp has room for
+  int    envpFlag;          // set while envp matches the table
+  char   pid[16];           // value of $$
+  char   status[16];        // value of $?
+};
+
+/*********************************************************************
+ ** _hashName
+ ** Description: FNV-1a hash of a variable name
+ ** Parameters: const char* name, size_t length
+ *********************************************************************/
+static unsigned _hashName(const char* name, size_t length)
+{
+  unsigned hash = 2166136261u;
+
+  while (length-- > 0)
+  {
+    hash ^= (unsigned char)*name++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/*********************************************************************
+ ** _findSlot
+ ** Description: Returns the slot holding the name, or the empty slot
+ ** where it would be inserted
+ ** Parameters: VarTable* v, const char* name, size_t length,
+ ** unsigned hash
+ *********************************************************************/
+static int _findSlot(VarTable* v, const char* name, size_t length,
+                     unsigned hash)
+{
+  int mask = v->numSlots - 1;
+  int slot = hash & mask;
+
+  while (v->entries[slot].pair != NULL &&
+         (v->entries[slot].hash != hash ||
+          v->entries[slot].nameLength != length ||
+          memcmp(v->entries[slot].pair, name, length) != 0))
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+/*********************************************************************
+ ** _setNumSlots
+ ** Description: Moves the entries into a table of the given size
+ ** Parameters: VarTable* v, int numSlots (a power of two)
+ *********************************************************************/
+static void _setNumSlots(VarTable* v, int numSlots)
+{
+  struct varEntry* oldEntries = v->entries;
+  struct varEntry* entry;
+  int oldNumSlots = v->numSlots,
+      i;
+
+  v->entries = calloc(numSlots, sizeof(struct varEntry));
+  assert(v->entries != 0);
+  v->numSlots = numSlots;
+
+  for (i = 0; i < oldNumSlots; i++)
+  {
+    entry = &oldEntries[i];
+    if (entry->pair != NULL)
+      v->entries[_findSlot(v, entry->pair, entry->nameLength,
+                           entry->hash)] = *entry;
+  }
+  free(oldEntries);
+}
+
+/*********************************************************************
+ ** _putVar
+ ** Description: Stores the value under the name, which must be valid,
+ ** and returns its entry. A new variable is not exported
+ ** Parameters: VarTable* v, const char* name, size_t length,
+ ** const char* value
+ *********************************************************************/
+static struct varEntry* _putVar(VarTable* v, const char* name,
+                                size_t length, const char* value)
+{
+  struct varEntry* entry;
+  unsigned hash = _hashName(name, length);
+  size_t valueLength = strlen(value);
+  int slot = _findSlot(v, name, length, hash);
+  char* pair;
+
+  pair = malloc(length + valueLength + 2);
+  assert(pair != 0);
+  memcpy(pair, name, length);
+  pair[length] = '=';
+  memcpy(pair + length + 1, value, valueLength + 1);
+
+  entry = &v->entries[slot];
+  if (entry->pair != NULL)
+  {
+    free(entry->pair);
+    entry->pair = pair;
+    if (entry->exportFlag)
+      v->envpFlag = 0;
+    return entry;
+  }
+
+  if (2 * (v->size + 1) > v->numSlots)
+  {
+    _setNumSlots(v, 2 * v->numSlots);
+    slot = _findSlot(v, name, length, hash);
+  }
+  entry = &v->entries[slot];
+  entry->pair = pair;
+  entry->nameLength = length;
+  entry->hash = hash;
+  entry->exportFlag = 0;
+  v->size++;
+  return entry;
+}
+
+/*********************************************************************
+ ** createVarTable
+ ** Description: Allocates an empty table with room for cap variables
+ ** Parameters: int cap
+ *********************************************************************/
+VarTable* createVarTable(int cap)
+{
+  VarTable* v;
+  int numSlots = 8;
+
+  assert(cap > 0);
+  v = malloc(sizeof(VarTable));
+  assert(v != 0);
+  while (numSlots < 2 * cap)
+    numSlots *= 2;
+  v->entries = NULL;
+  v->numSlots = 0;
+  _setNumSlots(v, numSlots);
+  v->size = 0;
+  v->envp = NULL;
+  v->envpCapacity = 0;
+  v->envpFlag = 0;
+  snprintf(v->pid, sizeof(v->pid), "%d", (int)getpid());
+  strcpy(v->status, "0");
+  return v;
+}
+
+/*********************************************************************
+ ** deleteVarTable
+ ** Description: Frees the table and all its variables
+ ** Parameters: VarTable* v
+ *********************************************************************/
+void deleteVarTable(VarTable* v)
+{
+  int i;
+
+  assert(v != 0);
+  for (i = 0; i < v->numSlots; i++)
+    free(v->entries[i].pair);
+  free(v->entries);
+  free(v->envp);
+  free(v);
+}
+
+/*********************************************************************
+ ** importVarTable
+ ** Description: Adds each NAME=value string as an exported variable
+ ** Parameters: VarTable* v, char** envp
+ *********************************************************************/
+void importVarTable(VarTable* v, char** envp)
+{
+  const char* equals;
+
+  assert(v != 0);
+  for (; *envp != NULL; envp++)
+  {
+    equals = strchr(*envp, '=');
+    if (equals == NULL || !isNameVarTable(*envp, equals - *envp))
+      continue;
+    _putVar(v, *envp, equals - *envp, equals + 1)->exportFlag = 1;
+  }
+  v->envpFlag = 0;
+}
+
+/*********************************************************************
+ ** isNameVarTable
+ ** Description: Returns true (1) if the name is a valid identifier
+ ** Parameters: const char* name, size_t length
+ *********************************************************************/
+int isNameVarTable(const char* name, size_t length)
+{
+  size_t i;
+
+  if (length == 0 || (name[0] >= '0' && name[0] <= '9'))
+    return 0;
+  for (i = 0; i < length; i++)
+    if (!(name[i] == '_' || (name[i] >= 'a' && name[i] <= 'z') ||
+          (name[i] >= 'A' && name[i] <= 'Z') ||
+          (name[i] >= '0' && name[i] <= '9')))
+      return 0;
+  return 1;
+}
+
+/*********************************************************************
+ ** getVarTable
+ ** Description: Returns the value of a variable, or NULL if it is not
+ ** set
+ ** Parameters: VarTable* v, const char* name, size_t length
+ *********************************************************************/
+const char* getVarTable(VarTable* v, const char* name, size_t length)
+{
+  struct varEntry* entry;
+
+  assert(v != 0);
+  if (length == 1 && name[0] == '$')
+    return v->pid;
+  if (length == 1 && name[0] == '?')
+    return v->status;
+
+  entry = &v->entries[_findSlot(v, name, length, _hashName(name, length))];
+  if (entry->pair == NULL)
+    return NULL;
+  return entry->pair + entry->nameLength + 1;
+}
+
+/*********************************************************************
+ ** setVarTable
+ ** Description: Sets a variable. Returns -1 if the name is not valid
+ ** Parameters: VarTable* v, const char* name, size_t length,
+ ** const char* value
+ *********************************************************************/
+int setVarTable(VarTable* v, const char* name, size_t length,
+                const char* value)
+{
+  assert(v != 0);
+  if (!isNameVarTable(name, length))
+    return -1;
+  _putVar(v, name, length, value);
+  return 0;
+}
+
+/*********************************************************************
+ ** exportVarTable
+ ** Description: Marks a variable for export if it is set. Returns -1
+ ** if the name is not valid
+ ** Parameters: VarTable* v, const char* name, size_t length
+ *********************************************************************/
+int exportVarTable(VarTable* v, const char* name, size_t length)
+{
+  struct varEntry* entry;
+
+  assert(v != 0);
+  if (!isNameVarTable(name, length))
+    return -1;
+  entry = &v->entries[_findSlot(v, name, length, _hashName(name, length))];
+  if (entry->pair != NULL && !entry->exportFlag)
+  {
+    entry->exportFlag = 1;
+    v->envpFlag = 0;
+  }
+  return 0;
+}
+
+/*********************************************************************
+ ** unsetVarTable
+ ** Description: Removes a variable, if it is set
+ ** Parameters: VarTable* v, const char* name, size_t length
+ *********************************************************************/
+void unsetVarTable(VarTable* v, const char* name, size_t length)
+{
+  int mask,
+      slot,
+      next,
+      home;
+
+  assert(v != 0);
+  mask = v->numSlots - 1;
+  slot = _findSlot(v, name, length, _hashName(name, length));
+  if (v->entries[slot].pair == NULL)
+    return;
+
+  if (v->entries[slot].exportFlag)
+    v->envpFlag = 0;
+  free(v->entries[slot].pair);
+  v->entries[slot].pair = NULL;
+  v->size--;
+
+  // Backward-shift the probe chain so no tombstones are needed
+  next = (slot + 1) & mask;
+  while (v->entries[next].pair != NULL)
+  {
+    home = v->entries[next].hash & mask;
+    if (((next - home) & mask) >= ((next - slot) & mask))
+    {
+      v->entries[slot] = v->entries[next];
+      v->entries[next].pair = NULL;
+      slot = next;
+    }
+    next = (next + 1) & mask;
+  }
+}
+
+/*********************************************************************
+ ** setStatusVarTable
+ ** Description: Sets the value of $?
+ ** Parameters: VarTable* v, int exitValue
+ *********************************************************************/
+void setStatusVarTable(VarTable* v, int exitValue)
+{
+  assert(v != 0);
+  snprintf(v->status, sizeof(v->status), "%d", exitValue);
+}
+
+/*********************************************************************
+ ** envpVarTable
+ ** Description: Returns the exported variables as an environment,
+ ** rebuilding the array only if one has changed since the last call
+ ** Parameters: VarTable* v
+ *********************************************************************/
+char** envpVarTable(VarTable* v)
+{
+  int count = 0,
+      i;
+
+  assert(v != 0);
+  if (v->envpFlag)
+    return v->envp;
+
+  if (v->envpCapacity < v->size + 1)
+  {
+    free(v->envp);
+    v->envpCapacity = v->size + 1;
+    v->envp = malloc(sizeof(char*) * v->envpCapacity);
+    assert(v->envp != 0);
+  }
+  for (i = 0; i < v->numSlots; i++)
+    if (v->entries[i].pair != NULL && v->entries[i].exportFlag)
+      v->envp[count++] = v->entries[i].pair;
+  v->envp[count] = NULL;
+  v->envpFlag = 1;
+  return v->envp;
+}
+
+/*********************************************************************
+ ** _compareEntries
+ ** Description: qsort() comparison of two entry pointers by name
+ ** Parameters: const void* a, const void* b
+ *********************************************************************/
+static int _compareEntries(const void* a, const void* b)
+{
+  const struct varEntry* x = *(const struct varEntry* const*)a;
+  const struct varEntry* y = *(const struct varEntry* const*)b;
+  size_t length = x->nameLength < y->nameLength ? x->nameLength :
+                                                  y->nameLength;
+  int result = memcmp(x->pair, y->pair, length);
+
+  if (result != 0)
+    return result;
+  return (x->nameLength > y->nameLength) - (x->nameLength < y->nameLength);
+}
+
+/*********************************************************************
+ ** printVarTable
+ ** Description: Prints the variables sorted by name, one per line
+ ** Parameters: VarTable* v, OutputWriter* out, const char* prefix,
+ ** int exportedFlag (set to print only exported variables)
+ *********************************************************************/
+void printVarTable(VarTable* v, OutputWriter* out, const char* prefix,
+                   int exportedFlag)
+{
+  struct varEntry** sorted;
+  int count = 0,
+      i;
+
+  assert(v != 0);
+  sorted = malloc(sizeof(struct varEntry*) * (v->size + 1));
+  assert(sorted != 0);
+  for (i = 0; i < v->numSlots; i++)
+    if (v->entries[i].pair != NULL &&
+        (!exportedFlag || v->entries[i].exportFlag))
+      sorted[count++] = &v->entries[i];
+  qsort(sorted, count, sizeof(struct varEntry*), _compareEntries);
+
+  for (i = 0; i < count; i++)
+    printOutput(out, "%s%s\n", prefix, sorted[i]->pair);
+  free(sorted);
+}
@@ -0,0 +1,50 @@
+/* 	varTable.h : Shell variables and the environment passed to commands. */
+#ifndef VAR_TABLE_INCLUDED
+#define VAR_TABLE_INCLUDED 1
+
+#include <stddef.h>
+#include "outputWriter.h"
+
+typedef struct VarTable VarTable;
+
+VarTable *createVarTable(int cap);
+void deleteVarTable(VarTable *v);
+
+/* Adds each NAME=value string of an environment as an exported
+   variable. Strings whose name is not a valid identifier are skipped. */
+void importVarTable(VarTable *v, char **envp);
+
+/* Returns true (1) if the name is a letter or underscore followed by
+   letters, digits and underscores */
+int isNameVarTable(const char *name, size_t length);
+
+/* Returns the value of the variable, or NULL if it is not set. The
+   names $ and ? give the shell's process ID and the last foreground
+   status. The value stays valid until the variable next changes. */
+const char *getVarTable(VarTable *v, const char *name, size_t length);
+
+/* Sets a variable, keeping it exported if it was. Returns -1 if the
+   name is not valid, otherwise 0. */
+int setVarTable(VarTable *v, const char *name, size_t length,
+                const char *value);
+
+/* Marks a set variable for export. Returns -1 if the name is not
+   valid, otherwise 0; an unset name is left unset. */
+int exportVarTable(VarTable *v, const char *name, size_t length);
+
+void unsetVarTable(VarTable *v, const char *name, size_t length);
+
+/* Sets $? */
+void setStatusVarTable(VarTable *v, int exitValue);
+
+/* Returns the NULL-terminated NAME=value array of exported variables
+   for exec. It is built on the first call after an exported variable
+   changes and reused until the next change. */
+char **envpVarTable(VarTable *v);
+
+/* Prints NAME=value lines sorted by name, each after prefix. Only
+   exported variables are printed if exportedFlag is set. */
+void printVarTable(VarTable *v, OutputWriter *out, const char *prefix,
+                   int exportedFlag);
+
+#endif